@@ -0,0 +1,29 @@
+// Forced ahead of the lib/ sources when they are built as host programs
+// for benchmarking (see bench/Makefrag), so that JOS's functions get
+// their own names and the host C library's stay available to compare.
+
+#define printfmt	jos_printfmt
+#define vprintfmt	jos_vprintfmt
+#define vprintfmt_span	jos_vprintfmt_span
+#define vprintfmt_ops	jos_vprintfmt_ops
+#define snprintf	jos_snprintf
+#define vsnprintf	jos_vsnprintf
+
+#define strlen		jos_strlen
+#define strnlen		jos_strnlen
+#define strcpy		jos_strcpy
+#define strncpy		jos_strncpy
+#define strlcpy		jos_strlcpy
+#define strcmp		jos_strcmp
+#define strncmp		jos_strncmp
+#define strchr		jos_strchr
+#define strfind		jos_strfind
+#define memset		jos_memset
+#define memmove		jos_memmove
+#define memcpy		jos_memcpy
+#define memcmp		jos_memcmp
+#define bcmp		jos_bcmp
+#define memfind		jos_memfind
+#define strtol		jos_strtol
+#define cpu_detect	jos_cpu_detect
+#define cpu_features	jos_cpu_features
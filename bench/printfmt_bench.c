@@ -0,0 +1,333 @@
+// Host benchmark and differential fuzzer for lib/printfmt.c.
+//
+// usage: printfmt_bench [iterations [seed]]
+//
+// First times jos_vsnprintf (lib/printfmt.c, built by bench/Makefrag)
+// against the C library's vsnprintf on a few format mixes.  Then it
+// formats random specifications with both and reports any difference.
+// JOS formats differ from C's in a few places (no '#', no width for %c,
+// no precision for integers); the fuzzer only uses what they share,
+// translating %o, which JOS prints with a leading '0', and %n, which
+// JOS stores through a signed char pointer.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int jos_snprintf(char *buf, int n, const char *fmt, ...);
+int jos_vsnprintf(char *buf, int n, const char *fmt, va_list ap);
+uint32_t jos_cpu_detect(int sse);
+extern uint32_t jos_cpu_features;
+
+static uint32_t rng = 2463534242u;
+
+static uint32_t
+rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/***** Throughput *****/
+
+typedef int (*vsnprintf_t)(char *, int, const char *, va_list);
+
+static int
+call(vsnprintf_t f, char *buf, int n, const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+
+	va_start(ap, fmt);
+	r = f(buf, n, fmt, ap);
+	va_end(ap);
+	return r;
+}
+
+static int
+libc_vsnprintf(char *buf, int n, const char *fmt, va_list ap)
+{
+	return vsnprintf(buf, n, fmt, ap);
+}
+
+enum { MIX_INT, MIX_STR, MIX_PAD, MIX_BT, NMIX };
+
+static const char *mix_name[NMIX] = {
+	[MIX_INT]	= "integers",
+	[MIX_STR]	= "strings",
+	[MIX_PAD]	= "padding",
+	[MIX_BT]	= "backtrace",
+};
+
+// Format one line of the given mix, varying the arguments with i
+static int
+run_mix(vsnprintf_t f, int mix, char *buf, int n, unsigned i)
+{
+	switch (mix) {
+	case MIX_INT:
+		return call(f, buf, n, "%d %u %x %d %lld\n",
+			    (int) i, i * 2654435761u, i, -(int) i,
+			    (long long) i * 1000000007LL);
+	case MIX_STR:
+		return call(f, buf, n, "%s: %s (%s)\n", "kernel",
+			    (i & 1) ? "warning" : "a much longer message text",
+			    "kern/init.c");
+	case MIX_PAD:
+		return call(f, buf, n, "[%-8d|%08x|%10s|%+6d]\n",
+			    (int) i, i, "pad", (int) i - 500);
+	default:
+		return call(f, buf, n,
+			    "  eip %08x ebp %08x args %08x %08x %08x %08x %08x\n",
+			    0xf0100000 + i, 0xf010ff00 - i, i, i + 1, i + 2,
+			    i + 3, i + 4);
+	}
+}
+
+static void
+bench(unsigned iters)
+{
+	static const struct {
+		const char *name;
+		vsnprintf_t f;
+	} impl[] = {
+		{ "jos", jos_vsnprintf },
+		{ "libc", libc_vsnprintf },
+	};
+	char buf[256];
+	double t, rate[2];
+	unsigned i, sink = 0;
+	int mix, k;
+
+	printf("%-10s %14s %14s %8s\n", "mix", "jos fmt/s", "libc fmt/s",
+	       "jos/libc");
+	for (mix = 0; mix < NMIX; mix++) {
+		for (k = 0; k < 2; k++) {
+			t = now();
+			for (i = 0; i < iters; i++)
+				sink += run_mix(impl[k].f, mix, buf,
+						sizeof(buf), i);
+			rate[k] = iters / (now() - t);
+		}
+		printf("%-10s %14.0f %14.0f %8.2f\n", mix_name[mix], rate[0],
+		       rate[1], rate[0] / rate[1]);
+	}
+	if (sink == 0)
+		printf("(nothing formatted?)\n");
+}
+
+/***** Differential fuzzing *****/
+
+static int nbad;
+
+static void
+mismatch(const char *what, const char *fmt, const char *jos,
+	 const char *libc)
+{
+	if (nbad++ < 20)
+		printf("MISMATCH %s: format \"%s\"\n  jos  \"%s\"\n  libc \"%s\"\n",
+		       what, fmt, jos, libc);
+}
+
+// Compare both implementations on one format and argument of the given
+// type, for a full-size or a randomly truncated buffer.
+#define COMPARE(jfmt, cfmt, type, arg)					\
+	do {								\
+		char jb[512], cb[512];					\
+		int jr, cr, n = (rnd() & 1) ? 512 : 1 + rnd() % 8;	\
+		type a = (arg);						\
+		jr = jos_snprintf(jb, n, jfmt, a);			\
+		cr = snprintf(cb, n, cfmt, a);				\
+		if (jr != cr || strcmp(jb, cb) != 0)			\
+			mismatch("output", jfmt, jb, cb);		\
+	} while (0)
+
+static const char *strs[] = {
+	"", "a", "hello", "kern/monitor.c", "a string of thirty-two bytes...."
+};
+
+static void
+fuzz_one(void)
+{
+	char flags[8], spec[32], jfmt[48], cfmt[64];
+	const char *conv;
+	int nflags = 0, width = -1, k;
+	uint64_t v = ((uint64_t) rnd() << 32) | rnd();
+	union {
+		double d;
+		uint64_t u;
+	} d;
+
+	static const char *convs[] = {
+		"d", "u", "x", "o", "s", "c", "lld", "llu", "llx", "f", "g", "E"
+	};
+	conv = convs[rnd() % (sizeof(convs) / sizeof(convs[0]))];
+
+	// '0' is not a JOS flag for strings or chars, nor '#' for anything
+	for (k = rnd() % 3; k > 0; k--) {
+		char f = "+- 0"[rnd() % 4];
+		if (f == '0' && (*conv == 's' || *conv == 'c'))
+			continue;
+		flags[nflags++] = f;
+	}
+	flags[nflags] = '\0';
+	// JOS %c takes no width
+	if (rnd() % 2 && *conv != 'c')
+		width = rnd() % 24;
+
+	// JOS ignores precision for integers; C does not
+	spec[0] = '\0';
+	if (*conv == 's' && rnd() % 3 == 0)
+		snprintf(spec, sizeof(spec), ".%u", rnd() % 8);
+	else if (strchr("fgE", *conv) && rnd() % 2)
+		snprintf(spec, sizeof(spec), ".%u", rnd() % 20);
+
+	if (width >= 0)
+		snprintf(jfmt, sizeof(jfmt), "<%%%s%d%s%s>", flags, width,
+			 spec, conv);
+	else
+		snprintf(jfmt, sizeof(jfmt), "<%%%s%s%s>", flags, spec, conv);
+	strcpy(cfmt, jfmt);
+	if (*conv == 'o')
+		snprintf(cfmt, sizeof(cfmt), "<0%s", jfmt + 1);
+
+	if (rnd() % 4 == 0)
+		v >>= rnd() % 64;
+	switch (*conv) {
+	case 's':
+		COMPARE(jfmt, cfmt, const char *, strs[rnd() % 5]);
+		break;
+	case 'c':
+		COMPARE(jfmt, cfmt, int, ' ' + rnd() % 95);
+		break;
+	case 'l':
+		COMPARE(jfmt, cfmt, uint64_t, v);
+		break;
+	case 'f':
+	case 'g':
+	case 'E':
+		// Exact binary fractions, full of ties, or any finite double.
+		// JOS rounds correctly to 40 significant digits, so %f stays
+		// below 1e20.
+		d.u = ((uint64_t) rnd() << 32) | rnd();
+		if (rnd() % 2 || d.d != d.d || d.d - d.d != 0
+		    || (*conv == 'f' && (d.d >= 1e20 || d.d <= -1e20)))
+			d.d = (double) (int32_t) rnd() / (1 << (rnd() % 24));
+		COMPARE(jfmt, cfmt, double, d.d);
+		break;
+	default:
+		COMPARE(jfmt, cfmt, uint32_t, v);
+		break;
+	}
+}
+
+// %n, where JOS stores a signed char and C's equivalent is %hhn
+static void
+fuzz_n(void)
+{
+	char jfmt[64], cfmt[64], jb[256], cb[256];
+	signed char jn = 0, cn = 0;
+	int pad = rnd() % 120, x = rnd();
+
+	snprintf(jfmt, sizeof(jfmt), "%%%dd%%n|%%s", pad);
+	snprintf(cfmt, sizeof(cfmt), "%%%dd%%hhn|%%s", pad);
+	jos_snprintf(jb, sizeof(jb), jfmt, x, &jn, "tail");
+	snprintf(cb, sizeof(cb), cfmt, x, &cn, "tail");
+	if (jn != cn) {
+		snprintf(jb, sizeof(jb), "%d", jn);
+		snprintf(cb, sizeof(cb), "%d", cn);
+		mismatch("%n count", jfmt, jb, cb);
+	}
+}
+
+// Fixed cases that the lab grader and the monitor depend on
+static void
+regressions(void)
+{
+	static const char *infnan_fmts[] = {
+		"<%f>", "<%6f>", "<%-6f>", "<%+6f>", "<% 6f>", "<%06f>", "<%+g>",
+		"<%E>", "<%G>", "<%+8E>", "<%-7G>", "<% 06G>"
+	};
+	double infnan[4] = {
+		__builtin_inf(), -__builtin_inf(), __builtin_nan(""),
+		-__builtin_nan("")
+	};
+	char buf[512], ntest[256];
+	signed char c1 = 0, c2 = 0;
+	unsigned i, j;
+
+	jos_snprintf(buf, sizeof(buf), "6828 decimal is %o octal!%n\n%n",
+		     6828, &c1, &c2);
+	if (strcmp(buf, "6828 decimal is 015254 octal!\n") || c1 != 29
+	    || c2 != 30)
+		mismatch("%o/%n self-test", "6828 decimal is %o octal!%n\\n%n",
+			 buf, "6828 decimal is 015254 octal!\\n (29, 30)");
+
+	jos_snprintf(buf, sizeof(buf), "show me the sign: %+d, %+d", 1024,
+		     -1024);
+	if (strcmp(buf, "show me the sign: +1024, -1024"))
+		mismatch("%+d", "%+d, %+d", buf, "+1024, -1024");
+
+	jos_snprintf(buf, sizeof(buf), "%-8d.", 22);
+	if (strcmp(buf, "22      ."))
+		mismatch("%-8d", "%-8d.", buf, "22      .");
+
+	jos_snprintf(buf, sizeof(buf), "%n", NULL);
+	if (strcmp(buf, "\nerror! writing through NULL pointer! (%n argument)\n"))
+		mismatch("%n NULL", "%n", buf, "(NULL pointer error)");
+
+	// inf and nan, signed or not, in fields wider than them
+	for (i = 0; i < 4; i++)
+		for (j = 0; j < sizeof(infnan_fmts) / sizeof(infnan_fmts[0]); j++)
+			COMPARE(infnan_fmts[j], infnan_fmts[j], double,
+				infnan[i]);
+
+	// Precision cutting into or reaching past the shortest digits
+	COMPARE("%.2f", "%.2f", double, 183370299276657.375);
+	COMPARE("%E", "%E", double, 5e-324);
+	COMPARE("%.20E", "%.20E", double, 0.1);
+	COMPARE("%.0f", "%.0f", double, 2.5);
+
+	memset(ntest, 0xd, sizeof(ntest) - 1);
+	ntest[sizeof(ntest) - 1] = '\0';
+	jos_snprintf(buf, sizeof(buf), "%s%n", ntest, &c1);
+	if (c1 != -1 || !strstr(buf, "has been overflowed"))
+		mismatch("%n overflow", "%s%n", buf, "(overflow warning, -1)");
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned iters = 1000000, i;
+
+	if (argc > 1)
+		iters = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		rng = strtoul(argv[2], NULL, 0) | 1;
+	// The host OS saves SSE state, so lib/string.c may use it all
+	jos_cpu_features = jos_cpu_detect(1);
+
+	bench(iters);
+
+	regressions();
+	for (i = 0; i < iters; i++) {
+		fuzz_one();
+		if (i % 16 == 0)
+			fuzz_n();
+	}
+	printf("fuzz: %u formats, %d mismatches\n", iters, nbad);
+	return nbad != 0;
+}
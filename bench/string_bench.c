@@ -0,0 +1,386 @@
+// Host micro-benchmark for lib/string.c.
+//
+// usage: string_bench [-a nalign] [-m maxsize] [function...]
+//
+// Times each function on sizes from 1 byte to maxsize (default 1MB) in
+// powers of two, at every destination and source offset below nalign
+// (default 16, to reach every SSE2 head and tail), once for each set of
+// CPU features this machine has and once for the C library.  Prints
+// CSV, one row per measurement, with the best of several runs in TSC
+// cycles per call and per byte.
+//
+// The functions are memset, memcpy, memmove (between separate buffers),
+// memmove_up and memmove_down (the destination below or above the
+// source by half the size, or by 64 bytes if that is more), memcmp and bcmp (of equal buffers),
+// strlen, strchr (of a character not in the string) and memfind.
+//
+// Before timing anything, checks every jos implementation against the
+// C library at each size up to 300 bytes and each pair of offsets, and
+// exits with an error if any result differs.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+// lib/string.c, built by bench/Makefrag with jos_ names
+void *jos_memset(void *, int, size_t);
+void *jos_memcpy(void *, const void *, size_t);
+void *jos_memmove(void *, const void *, size_t);
+int jos_memcmp(const void *, const void *, size_t);
+int jos_bcmp(const void *, const void *, size_t);
+int jos_strlen(const char *);
+char *jos_strchr(const char *, char);
+void *jos_memfind(const void *, int, size_t);
+uint32_t jos_cpu_detect(int sse);
+extern uint32_t jos_cpu_features;
+
+// The same feature bits as inc/cpufeature.h
+#define CPU_SSE2	0x01
+#define CPU_ERMS	0x02
+
+static volatile uintptr_t sink;
+
+static inline uint64_t
+rdtsc(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+	return (uint64_t) hi << 32 | lo;
+}
+
+/***** The functions, for each implementation *****/
+
+// One call: d and s are the destination and source (or the two buffers
+// compared, or the string), n the size
+typedef void (*op_t)(char *d, char *s, size_t n);
+
+#define OPS(pfx)							\
+static void pfx##_memset(char *d, char *s, size_t n)			\
+	{ sink += (uintptr_t) pfx##memset(d, 0x5a, n); }		\
+static void pfx##_memcpy(char *d, char *s, size_t n)			\
+	{ sink += (uintptr_t) pfx##memcpy(d, s, n); }			\
+static void pfx##_memmove(char *d, char *s, size_t n)			\
+	{ sink += (uintptr_t) pfx##memmove(d, s, n); }			\
+static void pfx##_memcmp(char *d, char *s, size_t n)			\
+	{ sink += pfx##memcmp(d, s, n); }				\
+static void pfx##_bcmp(char *d, char *s, size_t n)			\
+	{ sink += pfx##bcmp(d, s, n); }					\
+static void pfx##_strlen(char *d, char *s, size_t n)			\
+	{ sink += pfx##strlen(s); }					\
+static void pfx##_strchr(char *d, char *s, size_t n)			\
+	{ sink += (uintptr_t) pfx##strchr(s, 'z'); }			\
+static void pfx##_memfind(char *d, char *s, size_t n)			\
+	{ sink += (uintptr_t) pfx##memfind(s, 'z', n); }
+
+#define memfind(s, c, n)	(memchr(s, c, n) ?: (char *) (s) + (n))
+OPS()
+OPS(jos_)
+#undef memfind
+
+// How a function's buffers are laid out
+enum { SEP, UP, DOWN, STR };
+
+static const struct func {
+	const char *name;
+	int layout;
+	op_t libc, jos;
+} funcs[] = {
+	{ "memset",		SEP,	_memset,	jos__memset },
+	{ "memcpy",		SEP,	_memcpy,	jos__memcpy },
+	{ "memmove",		SEP,	_memmove,	jos__memmove },
+	{ "memmove_up",		UP,	_memmove,	jos__memmove },
+	{ "memmove_down",	DOWN,	_memmove,	jos__memmove },
+	{ "memcmp",		SEP,	_memcmp,	jos__memcmp },
+	{ "bcmp",		SEP,	_bcmp,		jos__bcmp },
+	{ "strlen",		STR,	_strlen,	jos__strlen },
+	{ "strchr",		STR,	_strchr,	jos__strchr },
+	{ "memfind",		STR,	_memfind,	jos__memfind },
+};
+#define NFUNCS	(sizeof(funcs) / sizeof(funcs[0]))
+
+/***** Measurement *****/
+
+#define PAD	64
+#define MAX(a, b)	((a) > (b) ? (a) : (b))
+static char *buf1, *buf2;
+
+// Best cycles per call of f over a few runs of enough calls to
+// outlast the timer's overhead
+static double
+measure(op_t f, char *d, char *s, size_t n)
+{
+	unsigned ncall = n >= 65536 ? 4 : 262144 / (n + 64), i, run;
+	uint64_t t, best = ~(uint64_t) 0;
+
+	f(d, s, n);
+	for (run = 0; run < 5; run++) {
+		t = rdtsc();
+		for (i = 0; i < ncall; i++)
+			f(d, s, n);
+		t = rdtsc() - t;
+		if (t < best)
+			best = t;
+	}
+	return (double) best / ncall;
+}
+
+// Set up the buffers for one measurement of fn; return the pointers
+static void
+setup(const struct func *fn, size_t n, int da, int sa, char **d, char **s)
+{
+	switch (fn->layout) {
+	case SEP:
+		*d = buf1 + da;
+		*s = buf2 + sa;
+		memset(*s, 'a', n);
+		memcpy(*d, *s, n);	// for the comparisons
+		break;
+	case UP:
+		*d = buf1 + da;
+		*s = buf1 + sa + MAX(n / 2, PAD);
+		break;
+	case DOWN:
+		*d = buf1 + da + MAX(n / 2, PAD);
+		*s = buf1 + sa;
+		break;
+	default:	// STR
+		*d = NULL;
+		*s = buf2 + sa;
+		memset(*s, 'a', n);
+		(*s)[n] = '\0';
+		break;
+	}
+}
+
+/***** Correctness *****/
+
+#define CHECK_MAX	300
+#define CHECK_LEN	(2 * CHECK_MAX + 4 * PAD)
+static char src[CHECK_LEN], got[CHECK_LEN], want[CHECK_LEN];
+static int nfail;
+
+static void
+fail(const char *fn, const char *impl, size_t n, int da, int sa)
+{
+	if (nfail++ < 20)
+		fprintf(stderr, "string_bench: %s (%s) wrong at size %zu, offsets %d/%d\n",
+			fn, impl, n, da, sa);
+}
+
+static unsigned
+rnd(void)
+{
+	static uint32_t x = 1;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+// One memory-to-memory call, on got by jos and on want by the C library,
+// with d and s as offsets into the buffers; the rest of both buffers
+// must come out the same as well
+static void
+check_mem(const char *fn, const char *impl, size_t n, int da, int sa,
+	  size_t d, size_t s)
+{
+	char *r1, *r2;
+
+	memcpy(got, src, CHECK_LEN);
+	memcpy(want, src, CHECK_LEN);
+	if (strcmp(fn, "memset") == 0) {
+		r1 = jos_memset(got + d, 0x5a, n);
+		r2 = memset(want + d, 0x5a, n);
+	} else if (strcmp(fn, "memcpy") == 0) {
+		r1 = jos_memcpy(got + d, src + s, n);
+		r2 = memcpy(want + d, src + s, n);
+	} else {
+		r1 = jos_memmove(got + d, got + s, n);
+		r2 = memmove(want + d, want + s, n);
+	}
+	if (r1 - got != r2 - want || memcmp(got, want, CHECK_LEN) != 0)
+		fail(fn, impl, n, da, sa);
+}
+
+static int
+sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+// Check the jos functions against the C library at every size up to
+// CHECK_MAX and every pair of offsets below nalign, with the current
+// CPU features.  The bytes around the buffers differ from those in
+// them, so that reads and writes past either end show up.
+static void
+check(const char *impl, int nalign)
+{
+	char *a, *b, *p;
+	size_t n, i;
+	int da, sa, k;
+
+	for (n = 0; n <= CHECK_MAX; n++) {
+		for (i = 0; i < CHECK_LEN; i++)
+			src[i] = rnd();
+		for (da = 0; da < nalign; da++)
+			for (sa = 0; sa < nalign; sa++) {
+				// Separate, overlapping upward and downward
+				size_t gap = rnd() % (n + 1);
+
+				check_mem("memset", impl, n, da, sa, PAD + da, 0);
+				check_mem("memcpy", impl, n, da, sa,
+					  PAD + da, CHECK_MAX + 2 * PAD + sa);
+				check_mem("memmove", impl, n, da, sa,
+					  PAD + da, PAD + sa + gap);
+				check_mem("memmove", impl, n, da, sa,
+					  PAD + da + gap, PAD + sa);
+
+				// Equal, then differing first, last and
+				// somewhere in between, both ways round
+				a = got + PAD + da;
+				b = want + PAD + sa;
+				for (i = 0; i < n + PAD; i++) {
+					a[i] = 'a' + rnd() % 8;
+					b[i] = i < n ? a[i] : a[i] + 1;
+				}
+				a[-1] = b[-1] + 1;
+				for (k = 0; k < 7; k++) {
+					if (k > 0) {
+						if (n == 0)
+							break;
+						i = k < 3 ? 0 : k < 5 ? n - 1 : rnd() % n;
+						b[i] = a[i] + (k & 1 ? 1 : -1);
+					}
+					if (sign(jos_memcmp(a, b, n)) != sign(memcmp(a, b, n)))
+						fail("memcmp", impl, n, da, sa);
+					if (!jos_bcmp(a, b, n) != !bcmp(a, b, n))
+						fail("bcmp", impl, n, da, sa);
+					if (k > 0)
+						b[i] = a[i];
+				}
+
+				// A string of n bytes with a 'z' on either
+				// side, then one with a 'z' in it
+				if (da > 0)
+					continue;
+				p = got + PAD + sa;
+				p[-1] = p[n + 1] = 'z';
+				p[n] = '\0';
+				if ((size_t) jos_strlen(p) != n)
+					fail("strlen", impl, n, da, sa);
+				if (jos_strchr(p, 'z') != NULL)
+					fail("strchr", impl, n, da, sa);
+				if (jos_memfind(p, 'z', n) != p + n)
+					fail("memfind", impl, n, da, sa);
+				if (n == 0)
+					continue;
+				i = rnd() % n;
+				p[i] = 'z';
+				if (jos_strchr(p, 'z') != p + i)
+					fail("strchr", impl, n, da, sa);
+				if (jos_memfind(p, 'z', n) != p + i)
+					fail("memfind", impl, n, da, sa);
+			}
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: string_bench [-a nalign] [-m maxsize] [function...]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct impl {
+		const char *name;
+		uint32_t features;
+	} impls[] = {
+		{ "jos", 0 },
+		{ "jos+erms", CPU_ERMS },
+		{ "jos+sse2", CPU_SSE2 },
+		{ "jos+erms+sse2", CPU_ERMS | CPU_SSE2 },
+		{ "libc", 0 },
+	};
+	size_t maxsize = 1 << 20, n;
+	int nalign = 16, da, sa, opt, k;
+	uint32_t have;
+	char *d, *s;
+	unsigned f;
+
+	while ((opt = getopt(argc, argv, "a:m:")) != -1) {
+		switch (opt) {
+		case 'a':
+			nalign = atoi(optarg);
+			break;
+		case 'm':
+			maxsize = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (nalign < 1 || nalign > PAD)
+		usage();
+
+	// Room for overlapping moves of maxsize, plus the offsets
+	buf1 = aligned_alloc(4096, 2 * maxsize + 2 * PAD);
+	buf2 = aligned_alloc(4096, 2 * maxsize + 2 * PAD);
+	if (!buf1 || !buf2) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	memset(buf1, 'a', 2 * maxsize + 2 * PAD);
+	have = jos_cpu_detect(1);
+
+	for (k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+		if ((impls[k].features & have) != impls[k].features
+		    || strcmp(impls[k].name, "libc") == 0)
+			continue;
+		jos_cpu_features = impls[k].features;
+		check(impls[k].name, nalign);
+	}
+	if (nfail) {
+		fprintf(stderr, "string_bench: %d wrong results\n", nfail);
+		exit(1);
+	}
+
+	printf("function,impl,size,dalign,salign,cycles,cycles_per_byte\n");
+	for (f = 0; f < NFUNCS; f++) {
+		if (optind < argc) {
+			for (k = optind; k < argc; k++)
+				if (strcmp(argv[k], funcs[f].name) == 0)
+					break;
+			if (k == argc)
+				continue;
+		}
+		for (k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+			if ((impls[k].features & have) != impls[k].features)
+				continue;
+			jos_cpu_features = impls[k].features;
+			for (n = 1; n <= maxsize; n *= 2)
+				for (da = 0; da < nalign; da++)
+					for (sa = 0; sa < nalign; sa++) {
+						double c;
+
+						if (funcs[f].layout == STR && da > 0)
+							continue;
+						setup(&funcs[f], n, da, sa, &d, &s);
+						c = measure(strcmp(impls[k].name, "libc") == 0
+							    ? funcs[f].libc : funcs[f].jos,
+							    d, s, n);
+						printf("%s,%s,%zu,%d,%d,%.1f,%.3f\n",
+						       funcs[f].name, impls[k].name,
+						       n, da, sa, c, c / n);
+					}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef JOS_INC_CPUFEATURE_H
+#define JOS_INC_CPUFEATURE_H
+
+#include <inc/types.h>
+
+// Optional CPU features, tested with cpu_has()
+#define CPU_SSE2	0x01	// SSE2, with XMM state enabled by the OS
+#define CPU_ERMS	0x02	// fast rep movsb/stosb (ERMSB)
+#define CPU_SSE42	0x04	// SSE4.2, including crc32
+
+// The features code may use.  Zero until set from cpu_detect(): by
+// alternatives_init() in the kernel, or by the program itself.
+extern uint32_t cpu_features;
+
+uint32_t cpu_detect(bool sse);
+
+#ifdef JOS_KERNEL
+// In the kernel each cpu_has() is a 5-byte jmp to the code for CPUs
+// without the feature, recorded in the .altinstr section.  At boot,
+// alternatives_init() (kern/alternative.c) overwrites the jmps for
+// the features present with nops, so the test costs nothing at run
+// time.  Until then every feature reads as absent.
+struct alt_site {
+	uintptr_t addr;		// address of the jmp
+	uint32_t feature;	// CPU_* bit that turns it into a nop
+};
+
+static __inline bool __attribute__((always_inline))
+cpu_has(uint32_t feature)
+{
+	asm goto("1:\t.byte 0xe9\n\t"
+		 ".long %l[absent] - 2f\n"
+		 "2:\n\t"
+		 ".pushsection .altinstr, \"a\"\n\t"
+		 ".balign 4\n\t"
+		 ".long 1b, %c0\n\t"
+		 ".popsection"
+		 : : "i" (feature) : : absent);
+	return 1;
+absent:
+	return 0;
+}
+#else
+#define cpu_has(feature)	((cpu_features & (feature)) != 0)
+#endif
+
+#endif /* not JOS_INC_CPUFEATURE_H */
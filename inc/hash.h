@@ -0,0 +1,29 @@
+#ifndef JOS_INC_HASH_H
+#define JOS_INC_HASH_H
+
+#include <inc/types.h>
+
+// CRC-32C (Castagnoli) of len bytes at buf, continuing from crc: pass 0
+// for the first piece and the previous result for each later one.
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+// xxHash32 of len bytes at buf
+uint32_t xxh32(const void *buf, size_t len, uint32_t seed);
+
+// A hash of a NUL-terminated string, for hash tables
+uint32_t hash_str(const char *s);
+
+// Mix the bits of an integer key so that every input bit affects every
+// output bit.  For a table of 2^n buckets, take the top n bits.
+static __inline uint32_t
+hash32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+#endif /* not JOS_INC_HASH_H */
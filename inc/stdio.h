@@ -1,6 +1,7 @@
 #ifndef JOS_INC_STDIO_H
 #define JOS_INC_STDIO_H
 
+#include <inc/types.h>
 #include <inc/stdarg.h>
 
 #ifndef NULL
@@ -13,14 +14,34 @@ int	getchar(void);
 int	iscons(int fd);
 
 // lib/printfmt.c
+
+// One step of a precompiled format (see kern/fmtc.pl): either a literal
+// span of the format string, or a parsed conversion.  A list of them
+// ends with an all-zero entry.
+struct fmtop {
+	char conv;		// conversion character; 0 for a literal span
+	char padc;		// ' ', '0' or '-'
+	char sign;		// 0, '+' or ' '
+	uint8_t lflag;		// number of 'l's
+	uint8_t altflag;	// '#'
+	int width;		// -1 if none, FMTOP_STAR if taken from the args
+	int precision;		// likewise
+	uint16_t off;		// literal: offset and length in the format
+	uint16_t len;
+};
+#define FMTOP_STAR	(-2)
+
 void	printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
 void	vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list);
+void	vprintfmt_span(void (*putspan)(const char *, size_t, void *), void *putdat, const char *fmt, va_list);
+void	vprintfmt_ops(void (*putspan)(const char *, size_t, void *), void *putdat, const char *fmt, const struct fmtop *ops, va_list);
 int	snprintf(char *str, int size, const char *fmt, ...);
 int	vsnprintf(char *str, int size, const char *fmt, va_list);
 
 // lib/printf.c
 int	cprintf(const char *fmt, ...);
 int	vcprintf(const char *fmt, va_list);
+int	cprintf_ops(const char *fmt, const struct fmtop *ops, ...);
 
 // lib/fprintf.c
 int	printf(const char *fmt, ...);
@@ -253,9 +253,10 @@ static __inline void
 cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp)
 {
 	uint32_t eax, ebx, ecx, edx;
+	// Leaves with sub-leaves (such as 7, extended features) get sub-leaf 0
 	asm volatile("cpuid" 
 		: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-		: "a" (info));
+		: "a" (info), "c" (0));
 	if (eaxp)
 		*eaxp = eax;
 	if (ebxp)
@@ -0,0 +1,42 @@
+/* See COPYRIGHT for copyright information. */
+
+// Boot-time patching of cpu_has() tests (see inc/cpufeature.h).
+// The boot page tables map the kernel text writable, so the sites
+// can simply be stored to.
+
+#include <inc/x86.h>
+#include <inc/assert.h>
+#include <inc/cpufeature.h>
+
+#include <kern/alternative.h>
+#include <kern/fpu.h>
+
+// Bounds of the .altinstr section, from kernel.ld
+extern const struct alt_site __altinstr_start[], __altinstr_end[];
+
+// nopl 0(%eax,%eax,1): one instruction, on every CPU with these features
+static const uint8_t nop5[5] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+// Detect the CPU's features and enable the code for them.  Call once
+// fpu_init has decided whether SSE may be used.
+void
+alternatives_init(void)
+{
+	const struct alt_site *a;
+	uint8_t *p;
+	int i;
+
+	cpu_features = cpu_detect(fpu_sse);
+	for (a = __altinstr_start; a < __altinstr_end; a++) {
+		if (!(cpu_features & a->feature))
+			continue;
+		p = (uint8_t *) a->addr;
+		assert(p[0] == 0xe9 || p[0] == nop5[0]);
+		// Byte by byte: memcpy has sites of its own
+		for (i = 0; i < sizeof(nop5); i++)
+			p[i] = nop5[i];
+	}
+
+	// Serialize, so that no stale copy of the old code runs
+	cpuid(0, NULL, NULL, NULL, NULL);
+}
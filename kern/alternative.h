@@ -0,0 +1,11 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_ALTERNATIVE_H
+#define JOS_KERN_ALTERNATIVE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+void alternatives_init(void);
+
+#endif /* !JOS_KERN_ALTERNATIVE_H */
@@ -5,21 +5,25 @@
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/error.h>
+#include <inc/mmu.h>
+#include <inc/trap.h>
 
 #include <kern/console.h>
+#include <kern/picirq.h>
+#include <kern/tsc.h>
+#include <kern/log.h>
+#ifdef FBCONS
+#include <kern/fbcons.h>
+#endif
 
 static void cons_intr(int (*proc)(void));
-static void cons_putc(int c);
 
-// Stupid I/O delay routine necessitated by historical PC design flaws
-static void
-delay(void)
-{
-	inb(0x84);
-	inb(0x84);
-	inb(0x84);
-	inb(0x84);
-}
+// Counters for the 'consstat' monitor command
+static struct consstat cons_stat;
+
+// How long to wait for a slow output device before giving up on it
+#define CONS_TIMEOUT_US	10000
 
 /***** Serial I/O code *****/
 
@@ -33,6 +37,14 @@ delay(void)
 #define   COM_IER_RDI	0x01	//   Enable receiver data interrupt
 #define COM_IIR		2	// In:	Interrupt ID Register
 #define COM_FCR		2	// Out: FIFO Control Register
+#define   COM_FCR_ENABLE	0x01	//   Enable the 16550 FIFOs
+#define   COM_FCR_RCV_RST	0x02	//   Clear the receive FIFO
+#define   COM_FCR_XMT_RST	0x04	//   Clear the transmit FIFO
+#define   COM_FCR_TRIG_1	0x00	//   RX interrupt at 1 byte
+#define   COM_FCR_TRIG_4	0x40	//   RX interrupt at 4 bytes
+#define   COM_FCR_TRIG_8	0x80	//   RX interrupt at 8 bytes
+#define   COM_FCR_TRIG_14	0xC0	//   RX interrupt at 14 bytes
+#define COM_IIR_FIFO	0xC0	//   IIR bits set when the FIFOs are enabled
 #define COM_LCR		3	// Out: Line Control Register
 #define	  COM_LCR_DLAB	0x80	//   Divisor latch access bit
 #define	  COM_LCR_WLEN8	0x03	//   Wordlength: 8 bits
@@ -45,7 +57,36 @@ delay(void)
 #define   COM_LSR_TXRDY	0x20	//   Transmit buffer avail
 #define   COM_LSR_TSRE	0x40	//   Transmitter off
 
+// Fast serial mode: run the UART at SERIAL_BAUD with the 16550 FIFOs
+// enabled, and fill the transmit FIFO in bursts of up to COM_FIFO_SIZE
+// bytes per TXRDY instead of one byte per poll.  Build with
+// SERIAL_FIFO=0 to get the old unbuffered 8250 behaviour.
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD	115200
+#endif
+#ifndef SERIAL_FIFO
+#define SERIAL_FIFO	1
+#endif
+#ifndef SERIAL_RX_TRIGGER
+#define SERIAL_RX_TRIGGER	8	// 1, 4, 8 or 14 bytes
+#endif
+
+#if SERIAL_RX_TRIGGER >= 14
+#define COM_FCR_TRIG	COM_FCR_TRIG_14
+#elif SERIAL_RX_TRIGGER >= 8
+#define COM_FCR_TRIG	COM_FCR_TRIG_8
+#elif SERIAL_RX_TRIGGER >= 4
+#define COM_FCR_TRIG	COM_FCR_TRIG_4
+#else
+#define COM_FCR_TRIG	COM_FCR_TRIG_1
+#endif
+
+#define COM_CLOCK	115200	// UART input clock / 16
+#define COM_FIFO_SIZE	16	// 16550 transmit FIFO depth
+
 static bool serial_exists;
+static int serial_burst;	// bytes we may push per TXRDY (1 or 16)
+static int serial_room;		// bytes left in the current burst
 
 static int
 serial_proc_data(void)
@@ -62,44 +103,84 @@ serial_intr(void)
 		cons_intr(serial_proc_data);
 }
 
+// Wait until the transmit holding register (and, with the FIFOs on,
+// the whole transmit FIFO) is empty.
 static void
-serial_putc(int c)
+serial_wait_txrdy(void)
 {
-	int i;
-	
-	for (i = 0;
-	     !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY) && i < 12800;
-	     i++)
-		delay();
-	
-	outb(COM1 + COM_TX, c);
+	uint64_t t0, t, end;
+
+	if (!(inb(COM1 + COM_LSR) & COM_LSR_TXRDY)) {
+		t0 = t = read_tsc();
+		end = tsc_deadline_us(CONS_TIMEOUT_US);
+		while (!(inb(COM1 + COM_LSR) & COM_LSR_TXRDY)
+		       && (t = read_tsc()) < end)
+			__asm __volatile("pause");
+		cons_stat.serial_stall += t - t0;
+	}
+	serial_room = serial_burst;
+}
+
+// Push 'len' bytes, one FIFO-full per TXRDY event.
+static void
+serial_write(const char *buf, size_t len)
+{
+	int n;
+
+	while (len > 0) {
+		if (serial_room == 0)
+			serial_wait_txrdy();
+		n = MIN((size_t) serial_room, len);
+		outsb(COM1 + COM_TX, buf, n);
+		serial_room -= n;
+		buf += n;
+		len -= n;
+	}
 }
 
 static void
 serial_init(void)
 {
-	// Turn off the FIFO
+	uint16_t divisor = COM_CLOCK / SERIAL_BAUD;
+
+	// Turn off the FIFO while we reprogram the line
 	outb(COM1+COM_FCR, 0);
 	
 	// Set speed; requires DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_DLAB);
-	outb(COM1+COM_DLL, (uint8_t) (115200 / 9600));
-	outb(COM1+COM_DLM, 0);
+	outb(COM1+COM_DLL, (uint8_t) divisor);
+	outb(COM1+COM_DLM, (uint8_t) (divisor >> 8));
 
 	// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
 
-	// No modem controls
-	outb(COM1+COM_MCR, 0);
+	// No modem controls, but OUT2 gates the UART's IRQ line to the PIC
+	outb(COM1+COM_MCR, COM_MCR_OUT2);
 	// Enable rcv interrupts
 	outb(COM1+COM_IER, COM_IER_RDI);
 
+	// Enable and reset both FIFOs.  An 8250/16450 has no FIFO and
+	// leaves the IIR FIFO bits clear, so fall back to one byte per TXRDY.
+	serial_burst = 1;
+	if (SERIAL_FIFO) {
+		outb(COM1+COM_FCR, COM_FCR_ENABLE | COM_FCR_RCV_RST |
+		     COM_FCR_XMT_RST | COM_FCR_TRIG);
+		if ((inb(COM1+COM_IIR) & COM_IIR_FIFO) == COM_IIR_FIFO)
+			serial_burst = COM_FIFO_SIZE;
+		else
+			outb(COM1+COM_FCR, 0);
+	}
+	serial_room = 0;
+
 	// Clear any preexisting overrun indications and interrupts
 	// Serial port doesn't exist if COM_LSR returns 0xFF
 	serial_exists = (inb(COM1+COM_LSR) != 0xFF);
 	(void) inb(COM1+COM_IIR);
 	(void) inb(COM1+COM_RX);
 
+	// Enable serial interrupts
+	if (serial_exists)
+		irq_setmask_8259A(irq_mask_8259A & ~(1<<IRQ_SERIAL));
 }
 
 
@@ -108,16 +189,70 @@ serial_init(void)
 // For information on PC parallel port programming, see the class References
 // page.
 
+#define LPT1		0x378
+
+static bool lpt_exists;
+
 static void
 lpt_putc(int c)
 {
-	int i;
+	uint64_t t0, t, end;
+
+	if (!(inb(LPT1+1) & 0x80)) {
+		t0 = t = read_tsc();
+		end = tsc_deadline_us(CONS_TIMEOUT_US);
+		while (!(inb(LPT1+1) & 0x80) && (t = read_tsc()) < end)
+			__asm __volatile("pause");
+		cons_stat.lpt_stall += t - t0;
+	}
+	outb(LPT1+0, c);
+	outb(LPT1+2, 0x08|0x04|0x01);
+	outb(LPT1+2, 0x08);
+}
+
+static void
+lpt_write(const char *buf, size_t len)
+{
+	while (len-- > 0)
+		lpt_putc(*buf++);
+}
 
-	for (i = 0; !(inb(0x378+1) & 0x80) && i < 12800; i++)
-		delay();
-	outb(0x378+0, c);
-	outb(0x378+2, 0x08|0x04|0x01);
-	outb(0x378+2, 0x08);
+static void
+lpt_init(void)
+{
+	// The data latch of a real port reads back what was written to
+	// it; an empty I/O address floats to 0xFF.
+	outb(LPT1+0, 0xAA);
+	lpt_exists = (inb(LPT1+0) == 0xAA);
+	outb(LPT1+0, 0x55);
+	lpt_exists = lpt_exists && (inb(LPT1+0) == 0x55);
+	outb(LPT1+0, 0);
+}
+
+
+
+
+/***** QEMU/Bochs debug console output *****/
+// Bytes written to port 0xE9 go straight to the emulator's debugcon
+// backend (e.g. 'make DEBUGCON=jos.dbg qemu'): no status register to
+// poll and nothing to wait for.
+
+#define DEBUGCON	0xE9
+
+static bool debugcon_exists;
+
+static void
+debugcon_write(const char *buf, size_t len)
+{
+	outsb(DEBUGCON, buf, len);
+}
+
+static void
+debugcon_init(void)
+{
+	// The port reads back 0xE9 when the device is there; an empty
+	// I/O address reads 0xFF.
+	debugcon_exists = (inb(DEBUGCON) == DEBUGCON);
 }
 
 
@@ -126,15 +261,35 @@ lpt_putc(int c)
 /***** Text-mode CGA/VGA display output *****/
 
 static unsigned addr_6845;
-static uint16_t *crt_buf;
-static uint16_t crt_pos;
+static uint16_t *crt_buf;	// shadow copy of the screen, in RAM
+static uint16_t crt_pos;	// cursor, relative to crt_buf
+
+// All drawing and scrolling happens in crt_shadow at RAM speed.  Rows
+// that differ from video memory are marked in crt_dirty (bit i for
+// row i), and cga_flush copies just those rows out to VRAM.
+//
+// On the VRAM side the screen is a window into text memory that
+// scrolls by moving the CRTC start address, so a flush after a scroll
+// only has to program the new start and draw the exposed rows.  Only
+// when the window reaches the end of VRAM is the whole screen redrawn
+// at the top.
+static uint16_t crt_shadow[CRT_SIZE];
+static uint32_t crt_dirty;
+static unsigned crt_scrolls;	// scrolls not yet applied to crt_start
+
+#define CRT_ALLDIRTY	((1 << CRT_ROWS) - 1)
+
+static uint16_t *crt_vram;
+static unsigned crt_vram_cells;
+static unsigned crt_start;
+static unsigned crt_cursor;	// cursor position last sent to the CRTC
 
 static void
 cga_init(void)
 {
 	volatile uint16_t *cp;
 	uint16_t was;
-	unsigned pos;
+	unsigned pos, start;
 
 	cp = (uint16_t*) (KERNBASE + CGA_BUF);
 	was = *cp;
@@ -142,26 +297,141 @@ cga_init(void)
 	if (*cp != 0xA55A) {
 		cp = (uint16_t*) (KERNBASE + MONO_BUF);
 		addr_6845 = MONO_BASE;
+		// An MDA only has one screen's worth of memory
+		crt_vram_cells = CRT_SIZE;
 	} else {
 		*cp = was;
 		addr_6845 = CGA_BASE;
+		crt_vram_cells = CGA_VRAM_SIZE / sizeof(uint16_t);
 	}
 	
-	/* Extract cursor location */
+	/* Extract cursor location and display start address */
 	outb(addr_6845, 14);
 	pos = inb(addr_6845 + 1) << 8;
 	outb(addr_6845, 15);
 	pos |= inb(addr_6845 + 1);
+	outb(addr_6845, 12);
+	start = inb(addr_6845 + 1) << 8;
+	outb(addr_6845, 13);
+	start |= inb(addr_6845 + 1);
+
+	if (start + CRT_SIZE > crt_vram_cells || pos < start
+	    || pos >= start + CRT_SIZE)
+		start = 0;
+
+	crt_vram = (uint16_t*) cp;
+	crt_start = start;
+	crt_cursor = pos;
+
+	// Pick up whatever the BIOS left on the screen
+	crt_buf = crt_shadow;
+	memcpy(crt_buf, crt_vram + crt_start, CRT_SIZE * sizeof(uint16_t));
+	crt_pos = pos - start;
+	crt_dirty = 0;
+	crt_scrolls = 0;
+}
 
-	crt_buf = (uint16_t*) cp;
-	crt_pos = pos;
+static void
+cga_setstart(void)
+{
+	outb(addr_6845, 12);
+	outb(addr_6845 + 1, crt_start >> 8);
+	outb(addr_6845, 13);
+	outb(addr_6845 + 1, crt_start);
 }
 
+static void
+cga_setcursor(void)
+{
+	if (crt_cursor == crt_start + crt_pos)
+		return;
+	crt_cursor = crt_start + crt_pos;
 
+	/* move that little blinky thing */
+	outb(addr_6845, 14);
+	outb(addr_6845 + 1, crt_cursor >> 8);
+	outb(addr_6845, 15);
+	outb(addr_6845 + 1, crt_cursor);
+}
 
+// Copy the dirty rows of the shadow buffer to video memory and bring
+// the CRTC start address and cursor up to date.
 static void
-cga_putc(int c)
+cga_flush(void)
 {
+	volatile uint32_t *dst;
+	const uint32_t *src;
+	int row, i;
+
+	if (crt_scrolls) {
+		if (crt_scrolls < CRT_ROWS && crt_start + crt_scrolls * CRT_COLS
+		    + CRT_SIZE <= crt_vram_cells)
+			crt_start += crt_scrolls * CRT_COLS;
+		else {
+			crt_start = 0;
+			crt_dirty = CRT_ALLDIRTY;
+		}
+		crt_scrolls = 0;
+		cga_setstart();
+	}
+
+	for (row = 0; crt_dirty != 0; row++, crt_dirty >>= 1) {
+		if (!(crt_dirty & 1))
+			continue;
+		src = (const uint32_t *) (crt_buf + row * CRT_COLS);
+		dst = (volatile uint32_t *) (crt_vram + crt_start + row * CRT_COLS);
+		for (i = 0; i < CRT_COLS / 2; i++)
+			dst[i] = src[i];
+	}
+
+	cga_setcursor();
+}
+
+// Mark the rows holding cells [pos, pos + n) as needing a flush.
+static void
+cga_touch(unsigned pos, unsigned n)
+{
+	unsigned row;
+
+	if (n == 0)
+		return;
+	for (row = pos / CRT_COLS; row * CRT_COLS < pos + n; row++)
+		crt_dirty |= 1 << row;
+}
+
+// Characters that cga_emit has to interpret rather than just store.
+static bool
+cga_special(int c)
+{
+	return c == '\b' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static void
+cga_scroll(void)
+{
+	// What is the purpose of this?
+	if (crt_pos >= CRT_SIZE) {
+		int i;
+
+		memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
+		for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
+			crt_buf[i] = 0x0700 | ' ';
+		crt_pos -= CRT_COLS;
+
+		// Row i+1 in VRAM becomes row i once the start address moves
+		crt_dirty = (crt_dirty >> 1) | (1 << (CRT_ROWS - 1));
+		crt_scrolls++;
+		cons_stat.cga_scrolls++;
+	}
+}
+
+// Store one character at crt_pos in the shadow buffer.  Nothing reaches
+// the screen until the next cga_flush.
+static void
+cga_emit(int c)
+{
+	int i;
+
 	// if no attribute given, then use black on white
 	if (!(c & ~0xFF))
 		c |= 0x0700;
@@ -171,6 +441,7 @@ cga_putc(int c)
 		if (crt_pos > 0) {
 			crt_pos--;
 			crt_buf[crt_pos] = (c & ~0xff) | ' ';
+			cga_touch(crt_pos, 1);
 		}
 		break;
 	case '\n':
@@ -180,32 +451,39 @@ cga_putc(int c)
 		crt_pos -= (crt_pos % CRT_COLS);
 		break;
 	case '\t':
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
+		for (i = 0; i < 5; i++)
+			cga_emit((c & ~0xff) | ' ');
 		break;
 	default:
+		cga_touch(crt_pos, 1);
 		crt_buf[crt_pos++] = c;		/* write the character */
 		break;
 	}
 
-	// What is the purpose of this?
-	if (crt_pos >= CRT_SIZE) {
-		int i;
+	cga_scroll();
+}
 
-		memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-		for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-			crt_buf[i] = 0x0700 | ' ';
-		crt_pos -= CRT_COLS;
+// Write a whole span into the shadow buffer: runs of ordinary
+// characters are stored a line at a time.  The caller flushes.
+static void
+cga_write(const char *buf, size_t len)
+{
+	size_t n, room;
+
+	while (len > 0) {
+		room = MIN(len, (size_t) (CRT_SIZE - crt_pos));
+		for (n = 0; n < room && !cga_special((uint8_t) buf[n]); n++)
+			crt_buf[crt_pos + n] = 0x0700 | (uint8_t) buf[n];
+		cga_touch(crt_pos, n);
+		crt_pos += n;
+		buf += n;
+		len -= n;
+		if (n < room) {
+			cga_emit((uint8_t) *buf++);
+			len--;
+		} else
+			cga_scroll();
 	}
-
-	/* move that little blinky thing */
-	outb(addr_6845, 14);
-	outb(addr_6845 + 1, crt_pos >> 8);
-	outb(addr_6845, 15);
-	outb(addr_6845 + 1, crt_pos);
 }
 
 
@@ -308,6 +586,10 @@ static uint8_t *charcode[4] = {
 	ctlmap
 };
 
+// Set on Ctrl-Alt-Del.  This runs in the keyboard IRQ, which must not
+// write to the console, so cons_getc prints the message and resets.
+static volatile bool kbd_reboot;
+
 /*
  * Get data from the keyboard.  If we finish a character, return it.  Else 0.
  * Return -1 if no data.
@@ -352,10 +634,8 @@ kbd_proc_data(void)
 
 	// Process special keys
 	// Ctrl-Alt-Del: reboot
-	if (!(~shift & (CTL | ALT)) && c == KEY_DEL) {
-		cprintf("Rebooting!\n");
-		outb(0x92, 0x3); // courtesy of Chris Frost
-	}
+	if (!(~shift & (CTL | ALT)) && c == KEY_DEL)
+		kbd_reboot = 1;
 
 	return c;
 }
@@ -369,6 +649,10 @@ kbd_intr(void)
 static void
 kbd_init(void)
 {
+	// Drain the kbd buffer so that the controller raises a fresh IRQ
+	// for the next key.
+	kbd_intr();
+	irq_setmask_8259A(irq_mask_8259A & ~(1<<IRQ_KBD));
 }
 
 
@@ -396,6 +680,11 @@ cons_intr(int (*proc)(void))
 	while ((c = (*proc)()) != -1) {
 		if (c == 0)
 			continue;
+		// drop input rather than overrun unread characters
+		if ((cons.wpos + 1) % CONSBUFSIZE == cons.rpos) {
+			cons_stat.rx_dropped++;
+			continue;
+		}
 		cons.buf[cons.wpos++] = c;
 		if (cons.wpos == CONSBUFSIZE)
 			cons.wpos = 0;
@@ -410,9 +699,16 @@ cons_getc(void)
 
 	// poll for any pending input characters,
 	// so that this function works even when interrupts are disabled
-	// (e.g., when called from the kernel monitor).
-	serial_intr();
-	kbd_intr();
+	// (e.g., when called from the kernel monitor after a panic).
+	// Otherwise the IRQ handlers fill the buffer for us.
+	if (!(read_eflags() & FL_IF)) {
+		serial_intr();
+		kbd_intr();
+	}
+	if (kbd_reboot) {
+		cprintf("Rebooting!\n");
+		outb(0x92, 0x3); // courtesy of Chris Frost
+	}
 
 	// grab the next character from the input buffer.
 	if (cons.rpos != cons.wpos) {
@@ -424,25 +720,271 @@ cons_getc(void)
 	return 0;
 }
 
+// The output devices.  cons_init probes each one; devices that are
+// not there are never written to, so a missing printer or UART costs
+// nothing instead of a timeout per character.
+enum {
+	SINK_SERIAL,
+	SINK_LPT,
+	SINK_CGA,
+	SINK_DEBUGCON,
+#ifdef FBCONS
+	SINK_FB,
+#endif
+};
+
+static struct cons_sink cons_sinks[] = {
+	[SINK_SERIAL]	= { "serial", 0, 0, serial_write, NULL, 0 },
+	[SINK_LPT]	= { "lpt", 0, 0, lpt_write, NULL, 0 },
+	[SINK_CGA]	= { "cga", 0, 0, cga_write, cga_flush, 0 },
+	[SINK_DEBUGCON]	= { "debugcon", 0, 0, debugcon_write, NULL, 0 },
+#ifdef FBCONS
+	[SINK_FB]	= { "fb", 0, 0, fbcons_write, fbcons_flush, 0 },
+#endif
+};
+#define NSINKS (sizeof(cons_sinks)/sizeof(cons_sinks[0]))
+
+// return the i'th console output device, or NULL if there is none
+struct cons_sink *
+cons_sink_get(int i)
+{
+	if (i < 0 || i >= NSINKS)
+		return NULL;
+	return &cons_sinks[i];
+}
+
+// turn output to the named device on or off
+int
+cons_sink_enable(const char *name, bool enable)
+{
+	int i;
+
+	for (i = 0; i < NSINKS; i++) {
+		if (strcmp(cons_sinks[i].name, name) != 0)
+			continue;
+		if (enable && !cons_sinks[i].present)
+			return -E_INVAL;
+		cons_sinks[i].enabled = enable;
+		return 0;
+	}
+	return -E_INVAL;
+}
+
+// hand a span to every enabled device
+static void
+sinks_write(const char *buf, size_t len)
+{
+	int i;
+
+	for (i = 0; i < NSINKS; i++)
+		if (cons_sinks[i].enabled) {
+			cons_sinks[i].write(buf, len);
+			cons_sinks[i].nwritten += len;
+		}
+}
+
+static void
+sinks_flush(void)
+{
+	int i;
+
+	for (i = 0; i < NSINKS; i++)
+		if (cons_sinks[i].enabled && cons_sinks[i].flush)
+			cons_sinks[i].flush();
+}
+
+// The kernel log.  Everything written to the console is appended to
+// this ring first, and the devices are fed from it.  wpos counts every
+// byte ever logged and rpos the bytes handed to the devices so far, so
+// the ring always holds the last CONSLOGSIZE bytes of output for dmesg,
+// and [rpos, wpos) is what the devices have yet to see.  In async mode
+// that span is only pushed out by cons_drain (from the getchar idle
+// loop, on panic, or when the ring fills up).  Before cons_init there
+// are no devices, so output accumulates and is replayed once they come
+// up.  There is a single producer (the kernel) and a single consumer
+// (cons_push), so the free-running counters need no lock.  Both run in
+// thread context only: the IRQ handlers just queue input and never
+// print (see kbd_reboot).
+#ifndef CONS_ASYNC
+#define CONS_ASYNC	0
+#endif
+
+static struct {
+	char buf[CONSLOGSIZE];
+	volatile uint32_t rpos;
+	volatile uint32_t wpos;
+} conslog;
+
+static bool cons_async = CONS_ASYNC;
+static bool cons_ready;		// set once cons_init has probed the devices
+
+// hand everything the devices haven't seen yet to them
+static void
+cons_push(void)
+{
+	uint32_t rpos = conslog.rpos, wpos = conslog.wpos;
+	size_t n;
+
+	while (rpos != wpos) {
+		n = MIN(wpos - rpos, CONSLOGSIZE - rpos % CONSLOGSIZE);
+		sinks_write(&conslog.buf[rpos % CONSLOGSIZE], n);
+		rpos += n;
+	}
+	conslog.rpos = rpos;
+}
+
+static void
+conslog_put(const char *buf, size_t len)
+{
+	uint32_t wpos = conslog.wpos;
+	size_t n;
+
+	while (len > 0) {
+		// Once there are devices, don't overwrite what they
+		// haven't been sent yet
+		if (cons_ready && wpos - conslog.rpos == CONSLOGSIZE) {
+			conslog.wpos = wpos;
+			cons_drain();
+		}
+		n = MIN(len, (size_t) (CONSLOGSIZE - wpos % CONSLOGSIZE));
+		if (cons_ready)
+			n = MIN(n, (size_t) (CONSLOGSIZE - (wpos - conslog.rpos)));
+		memcpy(&conslog.buf[wpos % CONSLOGSIZE], buf, n);
+		wpos += n;
+		buf += n;
+		len -= n;
+	}
+	conslog.wpos = wpos;
+
+	// Early output that no longer fits is lost from the replay too
+	if (wpos - conslog.rpos > CONSLOGSIZE)
+		conslog.rpos = wpos - CONSLOGSIZE;
+}
+
+// push everything queued in async mode out to the devices
+void
+cons_drain(void)
+{
+	if (!cons_ready || conslog.rpos == conslog.wpos)
+		return;
+	cons_push();
+	sinks_flush();
+}
+
+// Copy up to len bytes of the log starting at offset *off, which is
+// first moved forward to the oldest byte still held if it has been
+// overwritten.  Returns the number of bytes copied.
+size_t
+cons_log_read(uint32_t *off, char *buf, size_t len)
+{
+	uint32_t wpos = conslog.wpos;
+	size_t n, done;
+
+	if ((int32_t) (wpos - *off) > CONSLOGSIZE)
+		*off = wpos - CONSLOGSIZE;
+	if ((int32_t) (wpos - *off) < 0)
+		return 0;
+	len = MIN(len, (size_t) (wpos - *off));
+	for (done = 0; done < len; done += n) {
+		n = MIN(len - done, CONSLOGSIZE - (*off + done) % CONSLOGSIZE);
+		memcpy(buf + done, &conslog.buf[(*off + done) % CONSLOGSIZE], n);
+	}
+	return len;
+}
+
+// switch between synchronous and asynchronous output
+void
+cons_set_async(bool async)
+{
+	if (!async)
+		cons_drain();
+	cons_async = async;
+}
+
+bool
+cons_get_async(void)
+{
+	return cons_async;
+}
+
+// copy out the console statistics, and optionally start counting anew
+void
+cons_getstat(struct consstat *st, bool reset)
+{
+	int i;
+
+	*st = cons_stat;
+	if (reset) {
+		memset(&cons_stat, 0, sizeof(cons_stat));
+		for (i = 0; i < NSINKS; i++)
+			cons_sinks[i].nwritten = 0;
+	}
+}
+
+// output a span of characters to the console, letting each device
+// consume the whole buffer at once.  The display may not show the
+// span until the next cons_flush().
+void
+cons_write(const char *buf, size_t len)
+{
+	if (len == 0)
+		return;
+	conslog_put(buf, len);
+	if (!cons_async && cons_ready)
+		cons_push();
+}
+
+// make everything written so far visible on the display
+void
+cons_flush(void)
+{
+	if (!cons_async)
+		sinks_flush();
+}
+
 // output a character to the console
 static void
 cons_putc(int c)
 {
-	serial_putc(c);
-	lpt_putc(c);
-	cga_putc(c);
+	char ch = c;
+
+	cons_write(&ch, 1);
+	cons_flush();
 }
 
 // initialize the console devices
 void
 cons_init(void)
 {
+	int i;
+
 	cga_init();
 	kbd_init();
 	serial_init();
+	lpt_init();
+	debugcon_init();
+
+	cons_sinks[SINK_SERIAL].present = serial_exists;
+	cons_sinks[SINK_LPT].present = lpt_exists;
+	cons_sinks[SINK_CGA].present = 1;
+	cons_sinks[SINK_DEBUGCON].present = debugcon_exists;
+#ifdef FBCONS
+	// Once the display is in graphics mode, text VRAM is gone
+	if (fbcons_init()) {
+		cons_sinks[SINK_FB].present = 1;
+		cons_sinks[SINK_CGA].present = 0;
+	}
+#endif
+	for (i = 0; i < NSINKS; i++)
+		cons_sinks[i].enabled = cons_sinks[i].present;
+
+	// Replay whatever was printed before there was anywhere to print it
+	cons_ready = 1;
+	if (!cons_async)
+		cons_drain();
 
 	if (!serial_exists)
-		cprintf("Serial port does not exist!\n");
+		log_warn("Serial port does not exist!\n");
 }
 
 
@@ -459,8 +1001,24 @@ getchar(void)
 {
 	int c;
 
-	while ((c = cons_getc()) == 0)
-		/* do nothing */;
+	while ((c = cons_getc()) == 0) {
+		// nothing else to do while we wait, so catch up on output
+		cons_drain();
+
+		// With interrupts on, sleep until the keyboard or serial IRQ
+		// fills the input buffer.  'sti; hlt' cannot be split by an
+		// interrupt, so a character arriving after the check still
+		// wakes us up.  With interrupts off, keep polling.  The
+		// "memory" clobbers make cons.wpos, which the IRQ handlers
+		// advance, be read afresh after cli and after each wakeup.
+		if (read_eflags() & FL_IF) {
+			__asm __volatile("cli" : : : "memory");
+			if (cons.rpos == cons.wpos)
+				__asm __volatile("sti; hlt" : : : "memory");
+			else
+				__asm __volatile("sti" : : : "memory");
+		}
+	}
 	return c;
 }
 
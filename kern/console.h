@@ -12,13 +12,44 @@
 #define MONO_BUF	0xB0000
 #define CGA_BASE	0x3D4
 #define CGA_BUF		0xB8000
+#define CGA_VRAM_SIZE	0x8000	// bytes of text memory at CGA_BUF
 
 #define CRT_ROWS	25
 #define CRT_COLS	80
 #define CRT_SIZE	(CRT_ROWS * CRT_COLS)
 
+#define CONSLOGSIZE	16384	// bytes of output kept for dmesg; a power of 2
+
+// A console output device.  Devices are probed in cons_init and only
+// those present and enabled are written to.
+struct cons_sink {
+	const char *name;
+	bool present;
+	bool enabled;
+	void (*write)(const char *buf, size_t len);
+	void (*flush)(void);	// optional: push buffered output to the device
+	uint64_t nwritten;	// bytes handed to write
+};
+
+// Where console time goes; see the 'consstat' monitor command.
+struct consstat {
+	uint64_t serial_stall;	// TSC cycles spent waiting for TXRDY
+	uint64_t lpt_stall;	// TSC cycles spent waiting for the printer
+	uint32_t rx_dropped;	// input characters lost to a full buffer
+	uint32_t cga_scrolls;
+};
+
 void cons_init(void);
 int cons_getc(void);
+void cons_write(const char *buf, size_t len);
+void cons_flush(void);
+void cons_drain(void);
+void cons_set_async(bool async);
+bool cons_get_async(void);
+size_t cons_log_read(uint32_t *off, char *buf, size_t len);
+struct cons_sink *cons_sink_get(int i);
+int cons_sink_enable(const char *name, bool enable);
+void cons_getstat(struct consstat *st, bool reset);
 
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
@@ -0,0 +1,315 @@
+/* See COPYRIGHT for copyright information. */
+
+// Graphical console on the Bochs/QEMU VBE linear frame buffer
+// ('-vga std').  Text is drawn into a back buffer in RAM, which is also
+// where scrolling happens, and fbcons_flush copies only the damaged
+// part of each text row out to the frame buffer.
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+#include <inc/string.h>
+
+#include <kern/fbcons.h>
+
+/***** Bochs VBE "DISPI" interface *****/
+
+#define VBE_DISPI_IOPORT_INDEX	0x01CE
+#define VBE_DISPI_IOPORT_DATA	0x01CF
+
+#define VBE_DISPI_INDEX_ID		0
+#define VBE_DISPI_INDEX_XRES		1
+#define VBE_DISPI_INDEX_YRES		2
+#define VBE_DISPI_INDEX_BPP		3
+#define VBE_DISPI_INDEX_ENABLE		4
+#define VBE_DISPI_INDEX_VIRT_WIDTH	6
+#define VBE_DISPI_INDEX_X_OFFSET	8
+#define VBE_DISPI_INDEX_Y_OFFSET	9
+
+#define VBE_DISPI_ID0		0xB0C0
+#define VBE_DISPI_ID5		0xB0C5
+#define VBE_DISPI_ENABLED	0x01
+#define VBE_DISPI_LFB_ENABLED	0x40
+
+// The Bochs/QEMU standard VGA PCI device, and where Bochs puts its frame
+// buffer when there is no PCI.
+#define PCI_VENDOR_BOCHS	0x1234
+#define PCI_DEVICE_BOCHS_VGA	0x1111
+#define VBE_DISPI_LFB_DEFAULT	0xE0000000
+
+// Kernel virtual address for the frame buffer.  All we have at this
+// point is entry_pgdir, so the frame buffer is mapped with 4MB pages in
+// an otherwise unused part of the address space.
+#define FBVA		0xD0000000
+
+static void
+dispi_write(uint16_t index, uint16_t val)
+{
+	outw(VBE_DISPI_IOPORT_INDEX, index);
+	outw(VBE_DISPI_IOPORT_DATA, val);
+}
+
+static uint16_t
+dispi_read(uint16_t index)
+{
+	outw(VBE_DISPI_IOPORT_INDEX, index);
+	return inw(VBE_DISPI_IOPORT_DATA);
+}
+
+static uint32_t
+pci_conf_read(int bus, int dev, int func, int reg)
+{
+	outl(0xCF8, 0x80000000 | bus << 16 | dev << 11 | func << 8 | reg);
+	return inl(0xCFC);
+}
+
+// Find the physical address of the frame buffer in BAR 0 of the VGA
+// device on bus 0.
+static physaddr_t
+fb_find_lfb(void)
+{
+	uint32_t id;
+	int dev;
+
+	for (dev = 0; dev < 32; dev++) {
+		id = pci_conf_read(0, dev, 0, 0);
+		if ((id & 0xFFFF) == PCI_VENDOR_BOCHS
+		    && (id >> 16) == PCI_DEVICE_BOCHS_VGA)
+			return pci_conf_read(0, dev, 0, 0x10) & ~0xF;
+	}
+	return VBE_DISPI_LFB_DEFAULT;
+}
+
+
+/***** Font *****/
+
+// The 8x16 text-mode font, copied out of VGA plane 2 before we leave
+// text mode, so we do not have to carry our own.
+static uint8_t fb_font[256][16];
+
+// fb_mask[bits][x] is all ones if pixel x of a glyph row with pattern
+// 'bits' is set, so a row renders as eight (mask & fg) | (~mask & bg)
+// stores with no per-pixel branches.
+static uint32_t fb_mask[256][8];
+
+static void
+vga_seq(int index, int val)
+{
+	outb(0x3C4, index);
+	outb(0x3C5, val);
+}
+
+static void
+vga_gc(int index, int val)
+{
+	outb(0x3CE, index);
+	outb(0x3CF, val);
+}
+
+static bool
+fb_load_font(void)
+{
+	volatile uint8_t *plane2 = (uint8_t *) (KERNBASE + 0xA0000);
+	uint32_t any = 0;
+	int c, y, x;
+
+	// Map plane 2, where the character generator lives, linearly at
+	// 0xA0000.  Each glyph occupies 32 bytes, of which 16 are used.
+	vga_seq(2, 0x04);	// write plane 2 only
+	vga_seq(4, 0x07);	// sequential addressing
+	vga_gc(4, 0x02);	// read plane 2
+	vga_gc(5, 0x00);	// no odd/even reads
+	vga_gc(6, 0x04);	// map 0xA0000-0xAFFFF
+	for (c = 0; c < 256; c++)
+		for (y = 0; y < 16; y++) {
+			fb_font[c][y] = plane2[c * 32 + y];
+			any |= fb_font[c][y];
+		}
+	// Back to the usual text mode settings
+	vga_seq(2, 0x03);
+	vga_seq(4, 0x03);
+	vga_gc(4, 0x00);
+	vga_gc(5, 0x10);
+	vga_gc(6, 0x0E);
+
+	for (c = 0; c < 256; c++)
+		for (x = 0; x < 8; x++)
+			fb_mask[c][x] = (c & (0x80 >> x)) ? 0xFFFFFFFF : 0;
+	return any != 0;
+}
+
+
+/***** Text console *****/
+
+#define FB_COLS		(FB_XRES / 8)
+#define FB_ROWS		(FB_YRES / 16)
+#define FB_FG		0x00AAAAAA	// light grey, like attribute 0x07
+#define FB_BG		0x00000000
+
+static volatile uint32_t *fb_lfb;
+static uint32_t fb_back[FB_XRES * FB_YRES];
+static int fb_pos;		// cursor cell, row * FB_COLS + col
+static int fb_drawn_cursor;	// cell where the cursor is drawn on screen
+
+// Damaged columns [fb_dmg_lo[row], fb_dmg_hi[row]) of each text row
+static uint16_t fb_dmg_lo[FB_ROWS];
+static uint16_t fb_dmg_hi[FB_ROWS];
+
+static void
+fb_damage(int row, int lo, int hi)
+{
+	if (fb_dmg_lo[row] >= fb_dmg_hi[row]) {
+		fb_dmg_lo[row] = lo;
+		fb_dmg_hi[row] = hi;
+	} else {
+		fb_dmg_lo[row] = MIN(fb_dmg_lo[row], (uint16_t) lo);
+		fb_dmg_hi[row] = MAX(fb_dmg_hi[row], (uint16_t) hi);
+	}
+}
+
+static void
+fb_drawglyph(int pos, int c)
+{
+	uint32_t *dst;
+	const uint32_t *m;
+	int y, x;
+
+	dst = fb_back + (pos / FB_COLS) * 16 * FB_XRES + (pos % FB_COLS) * 8;
+	for (y = 0; y < 16; y++, dst += FB_XRES) {
+		m = fb_mask[fb_font[c][y]];
+		for (x = 0; x < 8; x++)
+			dst[x] = (m[x] & FB_FG) | (~m[x] & FB_BG);
+	}
+	fb_damage(pos / FB_COLS, pos % FB_COLS, pos % FB_COLS + 1);
+}
+
+static void
+fb_scroll(void)
+{
+	int row;
+
+	if (fb_pos < FB_COLS * FB_ROWS)
+		return;
+	memmove(fb_back, fb_back + 16 * FB_XRES,
+		(FB_ROWS - 1) * 16 * FB_XRES * sizeof(uint32_t));
+	memset(fb_back + (FB_ROWS - 1) * 16 * FB_XRES, 0,
+	       16 * FB_XRES * sizeof(uint32_t));
+	fb_pos -= FB_COLS;
+	for (row = 0; row < FB_ROWS; row++)
+		fb_damage(row, 0, FB_COLS);
+}
+
+static void
+fb_putc(int c)
+{
+	int i;
+
+	switch (c) {
+	case '\b':
+		if (fb_pos > 0)
+			fb_drawglyph(--fb_pos, ' ');
+		break;
+	case '\n':
+		fb_pos += FB_COLS;
+		/* fallthru */
+	case '\r':
+		fb_pos -= fb_pos % FB_COLS;
+		break;
+	case '\t':
+		for (i = 0; i < 5; i++)
+			fb_putc(' ');
+		break;
+	default:
+		fb_drawglyph(fb_pos++, c);
+		break;
+	}
+	fb_scroll();
+}
+
+void
+fbcons_write(const char *buf, size_t len)
+{
+	while (len-- > 0)
+		fb_putc((uint8_t) *buf++);
+}
+
+// Copy the damaged rectangles to the frame buffer and draw the cursor
+// (an underline) there.  The cursor is never drawn into the back
+// buffer, so erasing it is just repainting its cell.
+void
+fbcons_flush(void)
+{
+	const uint32_t *src;
+	volatile uint32_t *dst;
+	int row, y, x, lo, hi;
+
+	if (fb_drawn_cursor != fb_pos && fb_drawn_cursor < FB_COLS * FB_ROWS)
+		fb_damage(fb_drawn_cursor / FB_COLS, fb_drawn_cursor % FB_COLS,
+			  fb_drawn_cursor % FB_COLS + 1);
+
+	for (row = 0; row < FB_ROWS; row++) {
+		lo = fb_dmg_lo[row] * 8;
+		hi = fb_dmg_hi[row] * 8;
+		if (lo >= hi)
+			continue;
+		for (y = row * 16; y < row * 16 + 16; y++) {
+			src = fb_back + y * FB_XRES;
+			dst = fb_lfb + y * FB_XRES;
+			for (x = lo; x < hi; x++)
+				dst[x] = src[x];
+		}
+		fb_dmg_lo[row] = fb_dmg_hi[row] = 0;
+	}
+
+	dst = fb_lfb + ((fb_pos / FB_COLS) * 16 + 14) * FB_XRES
+		+ (fb_pos % FB_COLS) * 8;
+	for (y = 0; y < 2; y++, dst += FB_XRES)
+		for (x = 0; x < 8; x++)
+			dst[x] = FB_FG;
+	fb_drawn_cursor = fb_pos;
+}
+
+// Switch to a FB_XRES x FB_YRES x 32 graphics mode and map the frame
+// buffer.  Returns false, leaving text mode alone, if there is no
+// Bochs VBE adapter or no VGA font to borrow.
+bool
+fbcons_init(void)
+{
+	extern pde_t entry_pgdir[];
+	physaddr_t pa, base;
+	uint16_t id;
+	uint32_t off;
+
+	id = dispi_read(VBE_DISPI_INDEX_ID);
+	if (id < VBE_DISPI_ID0 || id > VBE_DISPI_ID5)
+		return 0;
+	if (!fb_load_font())
+		return 0;
+
+	// Map the frame buffer with 4MB pages
+	pa = fb_find_lfb();
+	base = ROUNDDOWN(pa, PTSIZE);
+	lcr4(rcr4() | CR4_PSE);
+	for (off = 0; off < pa - base + sizeof(fb_back); off += PTSIZE)
+		entry_pgdir[PDX(FBVA + off)] = (base + off) | PTE_P | PTE_W | PTE_PS;
+	tlbflush();
+	fb_lfb = (volatile uint32_t *) (FBVA + (pa - base));
+
+	dispi_write(VBE_DISPI_INDEX_ENABLE, 0);
+	dispi_write(VBE_DISPI_INDEX_XRES, FB_XRES);
+	dispi_write(VBE_DISPI_INDEX_YRES, FB_YRES);
+	dispi_write(VBE_DISPI_INDEX_BPP, 32);
+	dispi_write(VBE_DISPI_INDEX_VIRT_WIDTH, FB_XRES);
+	dispi_write(VBE_DISPI_INDEX_X_OFFSET, 0);
+	dispi_write(VBE_DISPI_INDEX_Y_OFFSET, 0);
+	dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED);
+
+	// Start with a clean screen
+	fb_pos = 0;
+	fb_drawn_cursor = 0;
+	memset(fb_back, 0, sizeof(fb_back));
+	for (off = 0; off < FB_ROWS; off++)
+		fb_damage(off, 0, FB_COLS);
+	fbcons_flush();
+	return 1;
+}
@@ -0,0 +1,23 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_FBCONS_H
+#define JOS_KERN_FBCONS_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Frame buffer resolution; the console gets FB_XRES/8 x FB_YRES/16 cells.
+#ifndef FB_XRES
+#define FB_XRES		800
+#endif
+#ifndef FB_YRES
+#define FB_YRES		600
+#endif
+
+bool fbcons_init(void);
+void fbcons_write(const char *buf, size_t len);
+void fbcons_flush(void);
+
+#endif /* !JOS_KERN_FBCONS_H */
@@ -0,0 +1,36 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_FMTC_H
+#define JOS_KERN_FMTC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/stdio.h>
+
+// cprintf_c(fmt, ...) is cprintf with the format parsed at build time.
+// A file using it must be listed in KERN_FMTC_SRCFILES (kern/Makefrag)
+// and include its generated <kern/FILE.fmtc.h>, which kern/fmtc.pl
+// fills with one op list per call, named after the call's line.  The
+// argument count is checked against the format at compile time.
+// Formats the generator cannot handle fall back to the runtime parser.
+
+#define FMTC_CAT(a, b)		FMTC_CAT_(a, b)
+#define FMTC_CAT_(a, b)		a ## b
+
+#define FMTC_NARGS(...)							\
+	FMTC_NARGS_(_, ##__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9,	\
+		    8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define FMTC_NARGS_(_, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10,	\
+		    a11, a12, a13, a14, a15, a16, n, ...)	n
+
+// A negative array size if the format takes some other number of args
+#define FMTC_CHECK(line, ...)						\
+	((void) sizeof(char[FMTC_CAT(fmtc_N, line) < 0			\
+			    || FMTC_CAT(fmtc_N, line) == FMTC_NARGS(__VA_ARGS__) ? 1 : -1]))
+
+#define cprintf_c(fmt, ...)						\
+	(FMTC_CHECK(__LINE__, ##__VA_ARGS__),				\
+	 cprintf_ops(fmt, FMTC_CAT(fmtc_L, __LINE__), ##__VA_ARGS__))
+
+#endif /* !JOS_KERN_FMTC_H */
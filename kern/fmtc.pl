@@ -0,0 +1,132 @@
+#!/usr/bin/perl
+#
+# Precompile the constant formats of cprintf_c() calls in a C file.
+#
+# Usage: fmtc.pl file.c > file.fmtc.h
+#
+# For a call on line N, the output defines fmtc_LN, a struct fmtop list
+# for vprintfmt_ops(), and fmtc_NN, the number of arguments the format
+# takes.  Formats this script cannot handle (not a plain string literal,
+# or an unknown conversion) get a NULL list and a count of -1, so they
+# are parsed at run time as usual.  See kern/fmtc.h.
+
+use strict;
+
+open(SRC, $ARGV[0]) || die "open $ARGV[0]: $!";
+my $src = join('', <SRC>);
+close SRC;
+
+my $base = $ARGV[0];
+$base =~ s,.*/,,;
+print "// Generated from $base by kern/fmtc.pl.  Do not edit.\n\n";
+
+# Decode the contents of a C string literal.
+sub unescape {
+	my ($s) = @_;
+	my %esc = ('n' => "\n", 't' => "\t", 'r' => "\r", 'a' => "\a",
+		   'b' => "\b", 'f' => "\f", 'v' => "\013");
+
+	$s =~ s/\\(x[0-9a-fA-F]+|[0-7]{1,3}|.)/
+		my $e = $1;
+		$e =~ m,^x(.*), ? chr(hex($1)) :
+		$e =~ m,^[0-7], ? chr(oct($e)) :
+		exists $esc{$e} ? $esc{$e} : $e
+	/ge;
+	return $s;
+}
+
+# Parse a format the way vprintfmt does.  Returns (ops, nargs), or
+# () if the format has to be left to the runtime parser.
+sub compile {
+	my ($fmt) = @_;
+	my @ops;
+	my $nargs = 0;
+	my $i = 0;
+	my $n = length($fmt);
+
+	while ($i < $n) {
+		my $j = index($fmt, '%', $i);
+		$j = $n if $j < 0;
+		push @ops, "{ .off = $i, .len = " . ($j - $i) . " }" if $j > $i;
+		last if $j == $n;
+		$i = $j + 1;
+
+		my ($padc, $sign, $lflag, $alt) = (' ', 0, 0, 0);
+		my ($width, $prec) = (-1, -1);
+		my $c;
+		while (1) {
+			return () if $i >= $n;
+			$c = substr($fmt, $i++, 1);
+			if ($c eq '+') {
+				$sign = '+';
+			} elsif ($c eq '-') {
+				$padc = '-';
+			} elsif ($c eq '0') {
+				$padc = '0' if $padc ne '-';
+			} elsif ($c eq ' ') {
+				$sign = ' ' if $sign ne '+';
+			} elsif ($c =~ /[1-9*]/) {
+				if ($c eq '*') {
+					$prec = 'FMTOP_STAR';
+					$nargs++;
+				} else {
+					substr($fmt, $i - 1) =~ /^(\d+)/;
+					$prec = $1;
+					$i += length($1) - 1;
+				}
+				($width, $prec) = ($prec, -1) if $width eq '-1';
+			} elsif ($c eq '.') {
+				$width = 0 if $width eq '-1';
+				if (substr($fmt, $i, 1) eq '*') {
+					$prec = 'FMTOP_STAR';
+					$nargs++;
+					$i++;
+				} else {
+					substr($fmt, $i) =~ /^(\d*)/;
+					$prec = $1 eq '' ? 0 : $1 + 0;
+					$i += length($1);
+				}
+			} elsif ($c eq '#') {
+				$alt = 1;
+			} elsif ($c eq 'l') {
+				$lflag++;
+			} else {
+				last;
+			}
+		}
+
+		if ($c eq '%') {
+			push @ops, "{ .off = " . ($i - 1) . ", .len = 1 }";
+		} elsif ($c =~ /^[cesduopxnfEgG]$/) {
+			my $s = $sign ? "'$sign'" : 0;
+			push @ops, "{ .conv = '$c', .padc = '$padc', .sign = $s, " .
+				   ".lflag = $lflag, .altflag = $alt, " .
+				   ".width = $width, .precision = $prec }";
+			$nargs++;
+		} else {
+			return ();
+		}
+	}
+	return (\@ops, $nargs);
+}
+
+my $str = qr/"(?:[^"\\\n]|\\.)*"/;
+
+while ($src =~ /\bcprintf_c\s*\(\s*((?:$str\s*)*)/g) {
+	my $lits = $1;
+	my $line = 1 + (substr($src, 0, $-[0]) =~ tr/\n//);
+	my $fmt = '';
+
+	$fmt .= unescape($1) while $lits =~ /"((?:[^"\\\n]|\\.)*)"/g;
+
+	my ($ops, $nargs) = compile($fmt);
+	if ($lits eq '' || !$ops || length($fmt) > 65535) {
+		print "#define fmtc_L$line ((const struct fmtop *) 0)\n";
+		print "#define fmtc_N$line (-1)\n\n";
+		next;
+	}
+	print "static const struct fmtop fmtc_L${line}[] = {\n";
+	print "\t$_,\n" foreach @$ops;
+	print "\t{ 0 }\n};\n";
+	print "#define fmtc_N$line $nargs\n\n";
+}
@@ -0,0 +1,32 @@
+/* See COPYRIGHT for copyright information. */
+
+// x87 and SSE setup.  The kernel keeps a single FPU context, which
+// _alltraps saves and restores around interrupt handlers; floating
+// point is for the kernel's own use (formatting rates and ratios, and
+// the like, and the SSE2 paths in lib/string.c).
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+
+#include <kern/fpu.h>
+
+#define CPUID_FXSR	(1 << 24)	// fxsave/fxrstor
+#define CPUID_SSE	(1 << 25)
+
+bool fpu_sse;
+
+void
+fpu_init(void)
+{
+	uint32_t edx;
+
+	// Native x87 with exceptions reported through #MF, not emulated
+	lcr0((rcr0() | CR0_MP | CR0_NE) & ~(CR0_EM | CR0_TS));
+	__asm __volatile("fninit");
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if ((edx & CPUID_FXSR) && (edx & CPUID_SSE)) {
+		lcr4(rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+		fpu_sse = 1;
+	}
+}
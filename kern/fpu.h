@@ -0,0 +1,17 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_FPU_H
+#define JOS_KERN_FPU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Set once fpu_init has enabled SSE state (CR4.OSFXSR), so that SSE and
+// SSE2 instructions may be used.
+extern bool fpu_sse;
+
+void fpu_init(void);
+
+#endif /* !JOS_KERN_FPU_H */
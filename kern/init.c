@@ -3,20 +3,28 @@
 #include <inc/stdio.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/x86.h>
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/trap.h>
+#include <kern/picirq.h>
+#include <kern/tsc.h>
+#include <kern/klog.h>
+#include <kern/log.h>
+#include <kern/fpu.h>
+#include <kern/alternative.h>
 
 // Test the stack backtrace function (lab 1 only)
 void
 test_backtrace(int x)
 {
-	cprintf("entering test_backtrace %d\n", x);
+	log_debug("entering test_backtrace %d\n", x);
 	if (x > 0)
 		test_backtrace(x-1);
 	else
 		mon_backtrace(0, 0, 0);
-	cprintf("leaving test_backtrace %d\n", x);
+	log_debug("leaving test_backtrace %d\n", x);
 }
 
 void
@@ -31,22 +39,37 @@ i386_init(void)
 	// This ensures that all static/global variables start out zero.
 	memset(edata, 0, end - edata);
 
+	// The formatter's %f/%g and the string routines' SSE paths need
+	// the FPU set up; then switch on the code for this CPU's features.
+	fpu_init();
+	alternatives_init();
+
+	// Measure the TSC so that device timeouts mean something.
+	tsc_calibrate();
+
 	// Initialize the console.
 	// Can't call cprintf until after we do this!
 	cons_init();
 
-	cprintf("6828 decimal is %o octal!%n\n%n", 6828, &chnum1, &chnum2);
-	cprintf("pading space in the right to number 22: %-8d.\n", 22);
-	cprintf("chnum1: %d chnum2: %d\n", chnum1, chnum2);
-	cprintf("%n", NULL);
+	// Take keyboard and serial input by interrupt from here on.
+	trap_init();
+	pic_init();
+	__asm __volatile("sti");
+
+	// printf self-tests (lab 1 only)
+	log_debug("6828 decimal is %o octal!%n\n%n", 6828, &chnum1, &chnum2);
+	log_debug("pading space in the right to number 22: %-8d.\n", 22);
+	log_debug("chnum1: %d chnum2: %d\n", chnum1, chnum2);
+	log_debug("%n", NULL);
 	memset(ntest, 0xd, sizeof(ntest) - 1);
-	cprintf("%s%n", ntest, &chnum1); 
-	cprintf("chnum1: %d\n", chnum1);
-	cprintf("show me the sign: %+d, %+d\n", 1024, -1024);
+	log_debug("%s%n", ntest, &chnum1);
+	log_debug("chnum1: %d\n", chnum1);
+	log_debug("show me the sign: %+d, %+d\n", 1024, -1024);
 
 
 	// Test the stack backtrace function (lab 1 only)
-	test_backtrace(5);
+	if (LOG_DEBUG <= LOG_LEVEL)
+		test_backtrace(5);
 
 	// Drop into the kernel monitor.
 	while (1)
@@ -76,12 +99,18 @@ _panic(const char *file, int line, const char *fmt,...)
 	// Be extra sure that the machine is in as reasonable state
 	__asm __volatile("cli; cld");
 
+	// Get any queued output out, and print synchronously from here on
+	cons_set_async(0);
+
 	va_start(ap, fmt);
 	cprintf("kernel panic at %s:%d: ", file, line);
 	vcprintf(fmt, ap);
 	cprintf("\n");
 	va_end(ap);
 
+	// Show what led up to it
+	klog_dump();
+
 dead:
 	/* break into the kernel monitor */
 	while (1)
@@ -100,3 +129,39 @@ _warn(const char *file, int line, const char *fmt,...)
 	cprintf("\n");
 	va_end(ap);
 }
+
+/* warn, at most WARN_BURST times in a row from any one call site */
+void
+_warn_limited(struct warn_limit *wl, const char *file, int line,
+	      const char *fmt, ...)
+{
+	uint64_t now = read_tsc(), period;
+	va_list ap;
+
+	// Refill one token per elapsed period, without dividing
+	period = tsc_ns2cycles(WARN_PERIOD_MS * 1000000ULL);
+	if (wl->stamp == 0 || now - wl->stamp >= WARN_BURST * period) {
+		wl->tokens = WARN_BURST;
+		wl->stamp = now;
+	}
+	for (; wl->tokens < WARN_BURST && now - wl->stamp >= period;
+	     wl->stamp += period)
+		wl->tokens++;
+
+	if (wl->tokens == 0) {
+		wl->suppressed++;
+		return;
+	}
+	wl->tokens--;
+
+	if (wl->suppressed) {
+		cprintf("kernel warning at %s:%d: %u similar warnings suppressed\n",
+			file, line, wl->suppressed);
+		wl->suppressed = 0;
+	}
+	va_start(ap, fmt);
+	cprintf("kernel warning at %s:%d: ", file, line);
+	vcprintf(fmt, ap);
+	cprintf("\n");
+	va_end(ap);
+}
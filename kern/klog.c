@@ -0,0 +1,88 @@
+/* See COPYRIGHT for copyright information. */
+
+// Deferred binary trace log.  klog() costs a timestamp and a handful of
+// word copies; formatting happens only when the ring is dumped.
+
+#include <inc/stdio.h>
+#include <inc/stdarg.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+
+#include <kern/klog.h>
+#include <kern/tsc.h>
+
+// There is only one CPU, so one ring; interrupts are held off while an
+// entry is filled so that a handler's klog cannot interleave with it.
+static struct {
+	struct klog_entry ent[KLOG_SIZE];
+	uint32_t pos;		// total entries ever logged
+} klog_ring;
+
+void
+klog(const char *fmt, ...)
+{
+	struct klog_entry *e;
+	uint32_t eflags;
+	va_list ap;
+	int i;
+
+	eflags = read_eflags();
+	__asm __volatile("cli");
+
+	e = &klog_ring.ent[klog_ring.pos++ & (KLOG_SIZE - 1)];
+	e->tsc = read_tsc();
+	e->fmt = fmt;
+	// Copy KLOG_NARGS words whether or not the caller passed that
+	// many: the extra ones are just the caller's stack and are never
+	// consumed by the format.
+	va_start(ap, fmt);
+	for (i = 0; i < KLOG_NARGS; i++)
+		e->args[i] = va_arg(ap, uint32_t);
+	va_end(ap);
+
+	if (eflags & FL_IF)
+		__asm __volatile("sti");
+}
+
+// Re-push the recorded words as arguments, recreating the call's
+// stack layout for vprintfmt.
+static void
+klog_print(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vcprintf(fmt, ap);
+	va_end(ap);
+}
+
+// Print the ring oldest first, with times in microseconds relative to
+// the oldest entry shown.
+void
+klog_dump(void)
+{
+	struct klog_entry *e;
+	uint32_t pos, i, n;
+	uint64_t t0;
+
+	pos = klog_ring.pos;
+	n = MIN(pos, KLOG_SIZE);
+	if (n == 0)
+		return;
+
+	t0 = klog_ring.ent[(pos - n) & (KLOG_SIZE - 1)].tsc;
+	for (i = pos - n; i != pos; i++) {
+		e = &klog_ring.ent[i & (KLOG_SIZE - 1)];
+		cprintf("[%10llu] ", (e->tsc - t0) * 1000 / tsc_khz);
+		klog_print(e->fmt, e->args[0], e->args[1], e->args[2],
+			   e->args[3], e->args[4], e->args[5]);
+	}
+	if (pos > KLOG_SIZE)
+		cprintf("(%u older entries overwritten)\n", pos - KLOG_SIZE);
+}
+
+void
+klog_clear(void)
+{
+	klog_ring.pos = 0;
+}
@@ -0,0 +1,31 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_KLOG_H
+#define JOS_KERN_KLOG_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Number of entries in the trace ring (a power of 2), and of argument
+// words recorded per entry.
+#define KLOG_SIZE	256
+#define KLOG_NARGS	6
+
+// A deferred trace record.  Nothing is formatted when it is logged:
+// the format pointer and raw argument words are decoded by klog_dump.
+struct klog_entry {
+	uint64_t tsc;
+	const char *fmt;
+	uint32_t args[KLOG_NARGS];
+};
+
+// Record a trace message.  fmt and any %s arguments must outlive the
+// ring (string literals, in practice), and the arguments may take at
+// most KLOG_NARGS words (a %llu takes two).
+void klog(const char *fmt, ...);
+void klog_dump(void);
+void klog_clear(void);
+
+#endif /* !JOS_KERN_KLOG_H */
@@ -0,0 +1,61 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_LOG_H
+#define JOS_KERN_LOG_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+// Message severities, most severe first.
+#define LOG_ERR		0
+#define LOG_WARN	1
+#define LOG_INFO	2
+#define LOG_DEBUG	3
+
+// Messages less severe than LOG_LEVEL are compiled out, format strings
+// and all.  Set it with 'make LOG_LEVEL=LOG_INFO' (or a number).
+#ifndef LOG_LEVEL
+#define LOG_LEVEL	LOG_DEBUG
+#endif
+
+#define log_printf(level, ...)					\
+	do {							\
+		if ((level) <= LOG_LEVEL)			\
+			cprintf(__VA_ARGS__);			\
+	} while (0)
+
+#define log_err(...)	log_printf(LOG_ERR, __VA_ARGS__)
+#define log_warn(...)	log_printf(LOG_WARN, __VA_ARGS__)
+#define log_info(...)	log_printf(LOG_INFO, __VA_ARGS__)
+#define log_debug(...)	log_printf(LOG_DEBUG, __VA_ARGS__)
+
+// Token bucket for one warn() call site: up to WARN_BURST warnings in a
+// row, refilled at one per WARN_PERIOD_MS.
+#define WARN_BURST	5
+#define WARN_PERIOD_MS	1000
+
+struct warn_limit {
+	uint64_t stamp;		// TSC at which the bucket was last refilled
+	uint32_t tokens;
+	uint32_t suppressed;	// warnings dropped since the last one shown
+};
+
+void _warn_limited(struct warn_limit *wl, const char *file, int line,
+		   const char *fmt, ...);
+
+// In kernel files that include this header, warn() is leveled and rate
+// limited per call site, replacing the plain one from inc/assert.h.
+#undef warn
+#define warn(...)							\
+	do {								\
+		static struct warn_limit warn_site_;			\
+		if (LOG_WARN <= LOG_LEVEL)				\
+			_warn_limited(&warn_site_, __FILE__, __LINE__,	\
+				      __VA_ARGS__);			\
+	} while (0)
+
+#endif /* !JOS_KERN_LOG_H */
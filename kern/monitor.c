@@ -10,6 +10,10 @@
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
+#include <kern/klog.h>
+#include <kern/tsc.h>
+#include <kern/fmtc.h>
+#include <kern/monitor.fmtc.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -26,6 +30,10 @@ static struct Command commands[] = {
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "backtrace", "Print a backtrace of the stack", mon_backtrace },
 	{ "time", "Count a program's running time", mon_time },
+	{ "cons", "List console devices, turn one on/off, or set async output", mon_cons },
+	{ "consstat", "Display and reset console statistics", mon_consstat },
+	{ "klog", "Dump the kernel trace log, or clear it", mon_klog },
+	{ "dmesg", "Show the console log, optionally from an offset or matching a pattern", mon_dmesg },
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -55,6 +63,7 @@ mon_kerninfo(int argc, char **argv, struct Trapframe *tf)
 	cprintf("  end    %08x (virt)  %08x (phys)\n", end, end - KERNBASE);
 	cprintf("Kernel executable memory footprint: %dKB\n",
 		(end-entry+1023)/1024);
+	cprintf("TSC frequency: %u kHz\n", tsc_khz);
 	return 0;
 }
 
@@ -81,12 +90,11 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 		for(uint32_t i = 0; i < 5; i++) {
 			args[i] = *((uint32_t *)(ebp + 8 + 4 * i));
 		}
-		cprintf("  eip %08x ebp %08x args %08x %08x %08x %08x %08x\n", eip, ebp, args[0], args[1], args[2], args[3], args[4]);
-		if(debuginfo_eip(eip, &info) == 0){
-			cprintf("	 %s:%d: ", info.eip_file, info.eip_line);
-			for(int i = 0; i < info.eip_fn_namelen; i++) cprintf("%c", info.eip_fn_name[i]);
-			cprintf("+%d\n", eip - info.eip_fn_addr);
-		}
+		cprintf_c("  eip %08x ebp %08x args %08x %08x %08x %08x %08x\n", eip, ebp, args[0], args[1], args[2], args[3], args[4]);
+		if(debuginfo_eip(eip, &info) == 0)
+			cprintf_c("\t %s:%d: %.*s+%d\n", info.eip_file, info.eip_line,
+				  info.eip_fn_namelen, info.eip_fn_name,
+				  eip - info.eip_fn_addr);
 
 		ebp = *((uint32_t *)ebp);
 		eip = *((uint32_t *)(ebp + 4));
@@ -113,7 +121,8 @@ mon_time(int argc, char **argv, struct Trapframe *tf)
 			__asm __volatile("rdtsc":"=a"(lo),"=d"(hi));
 			end = (uint64_t)hi << 32 | lo;
 
-			cprintf("%s cycles: %d\n", commands[i].name, end - start);
+			cprintf("%s cycles: %llu (%.3f us)\n", commands[i].name,
+				end - start, (double) (end - start) * 1000 / tsc_khz);
 			return 0;
 		} else if(strcmp(commands[i].name, "time") == 0 && strcmp(argv[1], "time") == 0){
 			// Multiple time commands act like one time command
@@ -125,6 +134,116 @@ mon_time(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_cons(int argc, char **argv, struct Trapframe *tf)
+{
+	struct cons_sink *sink;
+	int i;
+
+	if (argc == 1) {
+		for (i = 0; (sink = cons_sink_get(i)) != NULL; i++)
+			cprintf("  %-8s %s\n", sink->name,
+				!sink->present ? "absent" :
+				sink->enabled ? "on" : "off");
+		cprintf("  %-8s %s\n", "async", cons_get_async() ? "on" : "off");
+		return 0;
+	}
+	if (argc != 3 || (strcmp(argv[2], "on") != 0 && strcmp(argv[2], "off") != 0)) {
+		cprintf("Usage: cons [device|async on|off]\n");
+		return 0;
+	}
+	if (strcmp(argv[1], "async") == 0)
+		cons_set_async(strcmp(argv[2], "on") == 0);
+	else if (cons_sink_enable(argv[1], strcmp(argv[2], "on") == 0) < 0)
+		cprintf("Unknown or absent console device '%s'\n", argv[1]);
+	return 0;
+}
+
+int
+mon_consstat(int argc, char **argv, struct Trapframe *tf)
+{
+	struct cons_sink *sink;
+	struct consstat st;
+	uint64_t nwritten[8];
+	int i, n;
+
+	// Snapshot and reset everything before printing, so that this
+	// command's own output shows up in the next report, not this one.
+	for (n = 0; n < 8 && (sink = cons_sink_get(n)) != NULL; n++)
+		nwritten[n] = sink->nwritten;
+	cons_getstat(&st, 1);
+
+	for (i = 0; i < n; i++)
+		if (cons_sink_get(i)->present)
+			cprintf("  %-8s %llu bytes\n", cons_sink_get(i)->name, nwritten[i]);
+	cprintf("  serial TXRDY wait %llu cycles\n", st.serial_stall);
+	cprintf("  lpt busy wait     %llu cycles\n", st.lpt_stall);
+	cprintf("  input dropped     %u chars\n", st.rx_dropped);
+	cprintf("  cga scrolls       %u\n", st.cga_scrolls);
+	return 0;
+}
+
+int
+mon_klog(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc == 2 && strcmp(argv[1], "clear") == 0)
+		klog_clear();
+	else if (argc == 1)
+		klog_dump();
+	else
+		cprintf("usage: klog [clear]\n");
+	return 0;
+}
+
+// does the n-byte line contain pat?
+static bool
+line_match(const char *line, size_t n, const char *pat)
+{
+	size_t i, m = strlen(pat);
+
+	for (i = 0; i + m <= n; i++)
+		if (strncmp(line + i, pat, m) == 0)
+			return 1;
+	return 0;
+}
+
+int
+mon_dmesg(int argc, char **argv, struct Trapframe *tf)
+{
+	// This command's own output goes into the ring it reads, so copy
+	// what there is out first, before printing overwrites it
+	static char snap[CONSLOGSIZE];
+	char *p;
+	const char *pat = NULL;
+	uint32_t off = 0;
+	size_t i, n, len;
+
+	if (argc > 1 && *argv[1] >= '0' && *argv[1] <= '9') {
+		off = strtol(argv[1], &p, 0);
+		if (*p != '\0')
+			goto usage;
+		argc--, argv++;
+	}
+	if (argc > 2)
+		goto usage;
+	if (argc == 2)
+		pat = argv[1];
+
+	n = cons_log_read(&off, snap, sizeof(snap));
+	for (i = 0; i < n; i += len) {
+		p = memfind(snap + i, '\n', n - i);
+		len = (p < snap + n ? p + 1 : p) - (snap + i);
+		if (pat == NULL || line_match(snap + i, len, pat))
+			cprintf("[%6u] %.*s%s", off + i, len, snap + i,
+				snap[i + len - 1] == '\n' ? "" : "\n");
+	}
+	return 0;
+
+usage:
+	cprintf("usage: dmesg [offset] [pattern]\n");
+	return 0;
+}
+
 /***** Kernel monitor command interpreter *****/
 
 #define WHITESPACE "\t\r\n "
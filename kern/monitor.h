@@ -16,5 +16,9 @@ int mon_help(int argc, char **argv, struct Trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
 int mon_time(int argc, char **argv, struct Trapframe *tf);
+int mon_cons(int argc, char **argv, struct Trapframe *tf);
+int mon_consstat(int argc, char **argv, struct Trapframe *tf);
+int mon_klog(int argc, char **argv, struct Trapframe *tf);
+int mon_dmesg(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
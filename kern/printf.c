@@ -1,25 +1,67 @@
 // Simple implementation of cprintf console output for the kernel,
-// based on printfmt() and the kernel console's cputchar().
+// based on printfmt() and the kernel console's cons_write().
 
 #include <inc/types.h>
 #include <inc/stdio.h>
 #include <inc/stdarg.h>
+#include <inc/string.h>
 
+#include <kern/console.h>
+
+#define PRINTBUF_SIZE	256
+
+// Output is collected here and handed to the console a span at a time.
+struct printbuf {
+	int cnt;
+	int idx;
+	char buf[PRINTBUF_SIZE];
+};
 
 static void
-putch(int ch, int *cnt)
+putspan(const char *s, size_t len, struct printbuf *b)
 {
-	cputchar(ch);
-    (*cnt)++;
+	b->cnt += len;
+	if (b->idx + len > PRINTBUF_SIZE) {
+		cons_write(b->buf, b->idx);
+		b->idx = 0;
+		// Too big to be worth copying: hand it straight over
+		if (len > PRINTBUF_SIZE) {
+			cons_write(s, len);
+			return;
+		}
+	}
+	memcpy(b->buf + b->idx, s, len);
+	b->idx += len;
 }
 
 int
 vcprintf(const char *fmt, va_list ap)
 {
-	int cnt = 0;
+	struct printbuf b;
 
-	vprintfmt((void*)putch, &cnt, fmt, ap);
-	return cnt;
+	b.cnt = 0;
+	b.idx = 0;
+	vprintfmt_span((void*)putspan, &b, fmt, ap);
+	cons_write(b.buf, b.idx);
+	cons_flush();
+	return b.cnt;
+}
+
+// cprintf with fmt already compiled to ops (see kern/fmtc.h)
+int
+cprintf_ops(const char *fmt, const struct fmtop *ops, ...)
+{
+	struct printbuf b;
+	va_list ap;
+
+	b.cnt = 0;
+	b.idx = 0;
+	va_start(ap, ops);
+	vprintfmt_ops((void*)putspan, &b, fmt, ops, ap);
+	va_end(ap);
+	cons_write(b.buf, b.idx);
+	cons_flush();
+	return b.cnt;
 }
 
 int
@@ -34,4 +76,3 @@ cprintf(const char *fmt, ...)
 
 	return cnt;
 }
-
@@ -0,0 +1,57 @@
+#include <inc/mmu.h>
+#include <inc/x86.h>
+#include <inc/assert.h>
+#include <inc/memlayout.h>
+
+#include <kern/trap.h>
+#include <kern/console.h>
+#include <kern/picirq.h>
+#include <kern/klog.h>
+
+// Interrupt descriptor table.  (Must be built at run time because
+// shifted function addresses can't be represented in relocation records.)
+struct Gatedesc idt[256] = { { 0 } };
+struct Pseudodesc idt_pd = {
+	sizeof(idt) - 1, (uint32_t) idt
+};
+
+// Entry points for IRQ 0..15, in trapentry.S
+extern uint32_t irq_handlers[MAX_IRQS];
+
+// For now only device interrupts have gates; the kernel still has no
+// use for the processor exceptions.  The code segment is the flat one
+// the boot loader's GDT provides at GD_KT.
+void
+trap_init(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_IRQS; i++)
+		SETGATE(idt[IRQ_OFFSET + i], 0, GD_KT, irq_handlers[i], 0);
+
+	lidt(&idt_pd);
+}
+
+void
+trap(struct Trapframe *tf)
+{
+	klog("trap %d eip %08x\n", tf->tf_trapno, tf->tf_eip);
+
+	switch (tf->tf_trapno) {
+	case IRQ_OFFSET + IRQ_KBD:
+		kbd_intr();
+		break;
+	case IRQ_OFFSET + IRQ_SERIAL:
+		serial_intr();
+		break;
+	case IRQ_OFFSET + IRQ_SPURIOUS:
+		// The 8259A raises IRQ 7 for glitches on the interrupt lines.
+		break;
+	default:
+		// Nothing else is unmasked.  The master PIC runs in automatic
+		// EOI mode, but the slave needs an explicit EOI.
+		if (tf->tf_trapno >= IRQ_OFFSET + 8)
+			outb(IO_PIC2, 0x20);
+		break;
+	}
+}
@@ -0,0 +1,85 @@
+/* See COPYRIGHT for copyright information. */
+
+// Time stamp counter calibration and busy-wait delays.
+
+#include <inc/x86.h>
+
+#include <kern/tsc.h>
+
+#define PIT_HZ		1193182		// 8254 input clock
+#define PIT_CH2		0x42		// channel 2 data port
+#define PIT_MODE	0x43		// mode/command register
+#define PIT_GATE	0x61		// channel 2 gate (bit 0), OUT2 (bit 5)
+
+#define CAL_MS		10		// calibration interval
+
+// Until tsc_calibrate runs, assume a fast CPU so that delays err on
+// the long side.
+uint32_t tsc_khz = 4000000;
+
+// Cycles per nanosecond in 12.20 fixed point, so that converting a
+// delay needs a multiply and a shift rather than a 64-bit divide.
+static uint32_t tsc_ns_mult = 4 << 20;
+
+// Measure the TSC frequency by counting cycles while PIT channel 2
+// counts down CAL_MS milliseconds in mode 0.
+void
+tsc_calibrate(void)
+{
+	uint64_t t0, t1;
+	uint32_t latch = PIT_HZ / (1000 / CAL_MS);
+	int i;
+
+	// Gate channel 2 on, speaker off
+	outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);
+
+	// Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+	outb(PIT_MODE, 0xB0);
+	outb(PIT_CH2, latch & 0xFF);
+	outb(PIT_CH2, latch >> 8);
+
+	t0 = read_tsc();
+	for (i = 0; !(inb(PIT_GATE) & 0x20) && i < 10000000; i++)
+		/* do nothing */;
+	t1 = read_tsc();
+
+	// No PIT (or no TSC): keep the pessimistic default
+	if (!(inb(PIT_GATE) & 0x20) || t1 <= t0)
+		return;
+
+	tsc_khz = (uint32_t) ((t1 - t0) / CAL_MS);
+	tsc_ns_mult = (uint32_t) (((uint64_t) tsc_khz << 20) / 1000000);
+}
+
+uint64_t
+tsc_ns2cycles(uint64_t ns)
+{
+	return (ns * tsc_ns_mult) >> 20;
+}
+
+// The TSC value us microseconds from now.  A wait for a device is
+// bounded by polling until read_tsc() passes it.
+uint64_t
+tsc_deadline_us(uint32_t us)
+{
+	return read_tsc() + tsc_ns2cycles((uint64_t) us * 1000);
+}
+
+static void
+tsc_spin_until(uint64_t end)
+{
+	while (read_tsc() < end)
+		__asm __volatile("pause");
+}
+
+void
+ndelay(uint32_t ns)
+{
+	tsc_spin_until(read_tsc() + tsc_ns2cycles(ns));
+}
+
+void
+udelay(uint32_t us)
+{
+	tsc_spin_until(tsc_deadline_us(us));
+}
@@ -0,0 +1,20 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_TSC_H
+#define JOS_KERN_TSC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// TSC frequency, measured against the PIT by tsc_calibrate().
+extern uint32_t tsc_khz;
+
+void tsc_calibrate(void);
+uint64_t tsc_ns2cycles(uint64_t ns);
+uint64_t tsc_deadline_us(uint32_t us);
+void ndelay(uint32_t ns);
+void udelay(uint32_t us);
+
+#endif /* !JOS_KERN_TSC_H */
@@ -0,0 +1,32 @@
+// CPU feature detection for cpu_has(); see inc/cpufeature.h.
+
+#include <inc/cpufeature.h>
+#include <inc/x86.h>
+
+#define CPUID_SSE2	(1 << 26)	// leaf 1, edx
+#define CPUID_SSE42	(1 << 20)	// leaf 1, ecx
+#define CPUID7_ERMS	(1 << 9)	// leaf 7, ebx
+
+uint32_t cpu_features;
+
+// Return the CPU_* features of this CPU.  'sse' says whether SSE state
+// has been enabled (CR4.OSFXSR); without it the SSE features are left
+// out, as their instructions would fault.
+uint32_t
+cpu_detect(bool sse)
+{
+	uint32_t max, ebx, ecx, edx, f = 0;
+
+	cpuid(0, &max, NULL, NULL, NULL);
+	cpuid(1, NULL, NULL, &ecx, &edx);
+	if (sse && (edx & CPUID_SSE2))
+		f |= CPU_SSE2;
+	if (sse && (ecx & CPUID_SSE42))
+		f |= CPU_SSE42;
+	if (max >= 7) {
+		cpuid(7, NULL, &ebx, NULL, NULL);
+		if (ebx & CPUID7_ERMS)
+			f |= CPU_ERMS;
+	}
+	return f;
+}
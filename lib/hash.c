@@ -0,0 +1,146 @@
+// Checksums and hash functions; see inc/hash.h.
+
+#include <inc/hash.h>
+#include <inc/string.h>
+#include <inc/cpufeature.h>
+
+// An unaligned, aliasing 32-bit word
+typedef uint32_t __attribute__((__may_alias__, __aligned__(1))) uword_t;
+
+static __inline uint32_t
+rotl(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+/***** CRC-32C *****/
+
+#define CRC32C_POLY	0x82f63b78	// reflected
+
+// Slice-by-8 tables: crc32c_table[k][b] is the CRC of byte b followed
+// by k zero bytes, so eight table lookups consume eight bytes at once.
+// Filled in on first use.
+static uint32_t crc32c_table[8][256];
+static bool crc32c_table_ready;
+
+static void
+crc32c_init(void)
+{
+	uint32_t c;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c >> 1) ^ (CRC32C_POLY & -(c & 1));
+		crc32c_table[0][i] = c;
+	}
+	for (i = 0; i < 256; i++) {
+		c = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			c = (c >> 8) ^ crc32c_table[0][c & 0xff];
+			crc32c_table[j][i] = c;
+		}
+	}
+	crc32c_table_ready = 1;
+}
+
+static uint32_t
+crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+	uint32_t (*t)[256] = crc32c_table;
+	uint32_t lo, hi;
+
+	if (!crc32c_table_ready)
+		crc32c_init();
+	for (; len >= 8; p += 8, len -= 8) {
+		lo = crc ^ *(const uword_t *) p;
+		hi = *(const uword_t *) (p + 4);
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+			^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+			^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff]
+			^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+	for (; len > 0; p++, len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+	return crc;
+}
+
+// The SSE4.2 crc32 instruction computes the same CRC, a word at a time
+static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+	for (; len > 0 && ((uintptr_t) p & 3); p++, len--)
+		asm("crc32b %1, %0" : "+r" (crc) : "qm" (*p));
+	for (; len >= 4; p += 4, len -= 4)
+		asm("crc32l %1, %0" : "+r" (crc) : "rm" (*(const uword_t *) p));
+	for (; len > 0; p++, len--)
+		asm("crc32b %1, %0" : "+r" (crc) : "qm" (*p));
+	return crc;
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	crc = ~crc;
+	if (cpu_has(CPU_SSE42))
+		crc = crc32c_sse42(crc, buf, len);
+	else
+		crc = crc32c_sw(crc, buf, len);
+	return ~crc;
+}
+
+/***** xxHash32 *****/
+
+#define XXH_P1	2654435761U
+#define XXH_P2	2246822519U
+#define XXH_P3	3266489917U
+#define XXH_P4	668265263U
+#define XXH_P5	374761393U
+
+static __inline uint32_t
+xxh32_round(uint32_t acc, uint32_t in)
+{
+	return rotl(acc + in * XXH_P2, 13) * XXH_P1;
+}
+
+uint32_t
+xxh32(const void *buf, size_t len, uint32_t seed)
+{
+	const uint8_t *p = buf, *end = p + len;
+	uint32_t h, v1, v2, v3, v4;
+
+	if (len >= 16) {
+		v1 = seed + XXH_P1 + XXH_P2;
+		v2 = seed + XXH_P2;
+		v3 = seed;
+		v4 = seed - XXH_P1;
+		for (; end - p >= 16; p += 16) {
+			v1 = xxh32_round(v1, ((const uword_t *) p)[0]);
+			v2 = xxh32_round(v2, ((const uword_t *) p)[1]);
+			v3 = xxh32_round(v3, ((const uword_t *) p)[2]);
+			v4 = xxh32_round(v4, ((const uword_t *) p)[3]);
+		}
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+	} else
+		h = seed + XXH_P5;
+	h += len;
+
+	for (; end - p >= 4; p += 4)
+		h = rotl(h + *(const uword_t *) p * XXH_P3, 17) * XXH_P4;
+	for (; p < end; p++)
+		h = rotl(h + *p * XXH_P5, 11) * XXH_P1;
+
+	h ^= h >> 15;
+	h *= XXH_P2;
+	h ^= h >> 13;
+	h *= XXH_P3;
+	h ^= h >> 16;
+	return h;
+}
+
+uint32_t
+hash_str(const char *s)
+{
+	return xxh32(s, strlen(s), 0);
+}
@@ -16,6 +16,8 @@
  * and prints a string describing the error.
  * The integer may be positive or negative,
  * so that -E_NO_MEM and E_NO_MEM are equivalent.
+ *
+ * Doubles print with %f, %g/%G, or %E for scientific notation.
  */
 
 static const char * const error_string[MAXERROR] =
@@ -28,55 +30,795 @@ static const char * const error_string[MAXERROR] =
 	[E_FAULT]	= "segmentation fault",
 };
 
-//打印简单数字
+// Formatting state shared by a top-level call and the nested calls it
+// makes for %e and the %n diagnostics, so that the %n count covers
+// everything emitted regardless of what the sink does with it.
+struct printstate {
+	void (*putspan)(const char *, size_t, void *);
+	void *putdat;
+	int cnt;
+};
+
+static void psprintf(struct printstate *ps, const char *fmt, ...);
+
 static void
-printnnum(void (*putch)(int, void*), void *putdat,
-	 unsigned long long num, unsigned base, int* width)
+emit(struct printstate *ps, const char *s, size_t len)
 {
-	if (num >= base) printnnum(putch, putdat, num / base, base, width);
+	if (len == 0)
+		return;
+	ps->putspan(s, len, ps->putdat);
+	ps->cnt += len;
+}
 
-	putch("0123456789abcdef"[num % base], putdat);
-	(*width)--;
+static void
+emitc(struct printstate *ps, int ch)
+{
+	char c = ch;
+
+	emit(ps, &c, 1);
+}
+
+// Emit n copies of padc (' ' or '0') in spans of up to 16.
+static void
+emitpad(struct printstate *ps, int padc, int n)
+{
+	static const char spaces[] = "                ";
+	static const char zeros[] = "0000000000000000";
+	const char *s = (padc == '0' ? zeros : spaces);
+
+	for (; n > 0; n -= 16)
+		emit(ps, s, MIN(n, 16));
+}
+
+static const char digits[] = "0123456789abcdef";
+
+// Two-digit decimal strings "00" through "99", for converting a pair of
+// digits per division.
+static const char digits2[200] =
+	"00010203040506070809" "10111213141516171819"
+	"20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859"
+	"60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+// Room for the digits of any 64-bit number plus up to NUMPAD characters
+// of padding and sign on either side.
+#define NUMBUF	128
+#define NUMPAD	32
+
+// Divide *num by d in place and return the remainder, using two divl
+// instructions rather than libgcc's __udivdi3/__umoddi3.
+static uint32_t
+udiv64_32(unsigned long long *num, uint32_t d)
+{
+	uint32_t hi = *num >> 32, lo = *num, q, r;
+
+	q = hi / d;
+	hi %= d;
+	__asm __volatile("divl %4" : "=a" (lo), "=d" (r) : "0" (lo), "1" (hi), "rm" (d));
+	*num = ((unsigned long long) q << 32) | lo;
+	return r;
+}
+
+// Write the decimal digits of n backwards ending at p.  The pairs are
+// stored a byte at a time: with -fno-builtin, memcpy would be a call.
+static char *
+fmtdec32(char *p, uint32_t n)
+{
+	const char *d;
+
+	while (n >= 100) {
+		d = &digits2[(n % 100) * 2];
+		p -= 2;
+		p[0] = d[0];
+		p[1] = d[1];
+		n /= 100;
+	}
+	if (n >= 10) {
+		d = &digits2[n * 2];
+		p -= 2;
+		p[0] = d[0];
+		p[1] = d[1];
+	} else
+		*--p = '0' + n;
+	return p;
+}
+
+// Write the digits of num (base <= 16) backwards ending at p and return
+// a pointer to the most significant digit.
+static char *
+fmtnum(char *p, unsigned long long num, unsigned base)
+{
+	unsigned shift;
+	uint32_t n, r;
+	char *q;
+
+	switch (base) {
+	case 10:
+		// Peel off nine digits at a time until the rest fits in 32 bits
+		while (num >> 32) {
+			r = udiv64_32(&num, 1000000000);
+			for (q = fmtdec32(p, r), p -= 9; q > p; )
+				*--q = '0';
+		}
+		return fmtdec32(p, num);
+
+	case 8:
+	case 16:
+		shift = (base == 8 ? 3 : 4);
+		for (; num >> 32; num >>= shift)
+			*--p = digits[num & (base - 1)];
+		n = num;
+		do {
+			*--p = digits[n & (base - 1)];
+			n >>= shift;
+		} while (n);
+		return p;
+
+	default:
+		do {
+			*--p = digits[udiv64_32(&num, base)];
+		} while (num);
+		return p;
+	}
 }
 
 /*
- * Print a number (base <= 16) in reverse order,
- * using specified putch function and associated pointer putdat.
+ * Print a number (base <= 16) with the given prefix, sign and padding,
+ * assembling it in a stack buffer and emitting it as one span.
+ * The prefix ("0" for %o, "0x" for %p) is not counted in the width.
  */
 static void
-printnum(void (*putch)(int, void*), void *putdat,
-	 unsigned long long num, unsigned base, int width, int padc, int sign)
-{
-	// if cprintf'parameter includes pattern of the form "%-", padding
-	// space on the right side if neccesary.
-	// you can add helper function if needed.
-	// your code here:
-	if(padc == '-') {
-		if(sign != 0) { putch(sign, putdat); width--; }
-		printnnum(putch, putdat, num, base, &width);
-		for(; width > 0; width--) putch(' ', putdat);
+printnum(struct printstate *ps, unsigned long long num, unsigned base,
+	 int width, int padc, int sign, const char *prefix)
+{
+	char buf[NUMBUF], *p, *q;
+	int pad;
+
+	p = q = buf + NUMBUF / 2;
+	p = fmtnum(p, num, base);
+	pad = width - (q - p) - (sign != 0);
+
+	if (pad > NUMPAD) {
+		// Too wide to assemble in place
+		emit(ps, prefix, strlen(prefix));
+		if (sign && padc != ' ')
+			emitc(ps, sign);
+		if (padc != '-')
+			emitpad(ps, padc, pad);
+		if (sign && padc == ' ')
+			emitc(ps, sign);
+		emit(ps, p, q - p);
+		if (padc == '-')
+			emitpad(ps, ' ', pad);
 		return;
 	}
 
-	// first recursively print all preceding (more significant) digits
-	if (num >= base) {
-		printnum(putch, putdat, num / base, base, width - 1, padc, sign);
+	// '0' pads between the sign and the digits, ' ' before the sign,
+	// and '-' after the digits.
+	if (padc == '0')
+		for (; pad > 0; pad--)
+			*--p = '0';
+	if (sign)
+		*--p = sign;
+	if (padc == ' ')
+		for (; pad > 0; pad--)
+			*--p = ' ';
+	if (padc == '-')
+		for (; pad > 0; pad--)
+			*q++ = ' ';
+	for (pad = strlen(prefix); pad > 0; pad--)
+		*--p = prefix[pad - 1];
+	emit(ps, p, q - p);
+}
+
+/*
+ * Floating point.  Digits come from Grisu2 (Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", PLDI
+ * 2010), which produces the shortest (or very nearly shortest) digit
+ * string that reads back as the same double, using only 64-bit integer
+ * arithmetic.  %f, %E and %g round that digit string to the requested
+ * precision when it is sure to round the same way as the double itself.
+ * Otherwise, and whenever more digits are asked for than it has, the
+ * digits come from the exact binary value instead, with bignums.
+ */
+
+// A floating-point number f * 2^e with a 64-bit significand.
+struct diyfp {
+	uint64_t f;
+	int e;
+};
+
+// Normalized 10^k for k = -348, -340, ..., 340.
+static const struct {
+	uint64_t f;
+	int16_t e;
+} cached_pow10[] = {
+	{ 0xfa8fd5a0081c0288ULL, -1220 },	// 1e-348
+	{ 0xbaaee17fa23ebf76ULL, -1193 },	// 1e-340
+	{ 0x8b16fb203055ac76ULL, -1166 },	// 1e-332
+	{ 0xcf42894a5dce35eaULL, -1140 },	// 1e-324
+	{ 0x9a6bb0aa55653b2dULL, -1113 },	// 1e-316
+	{ 0xe61acf033d1a45dfULL, -1087 },	// 1e-308
+	{ 0xab70fe17c79ac6caULL, -1060 },	// 1e-300
+	{ 0xff77b1fcbebcdc4fULL, -1034 },	// 1e-292
+	{ 0xbe5691ef416bd60cULL, -1007 },	// 1e-284
+	{ 0x8dd01fad907ffc3cULL, -980 },	// 1e-276
+	{ 0xd3515c2831559a83ULL, -954 },	// 1e-268
+	{ 0x9d71ac8fada6c9b5ULL, -927 },	// 1e-260
+	{ 0xea9c227723ee8bcbULL, -901 },	// 1e-252
+	{ 0xaecc49914078536dULL, -874 },	// 1e-244
+	{ 0x823c12795db6ce57ULL, -847 },	// 1e-236
+	{ 0xc21094364dfb5637ULL, -821 },	// 1e-228
+	{ 0x9096ea6f3848984fULL, -794 },	// 1e-220
+	{ 0xd77485cb25823ac7ULL, -768 },	// 1e-212
+	{ 0xa086cfcd97bf97f4ULL, -741 },	// 1e-204
+	{ 0xef340a98172aace5ULL, -715 },	// 1e-196
+	{ 0xb23867fb2a35b28eULL, -688 },	// 1e-188
+	{ 0x84c8d4dfd2c63f3bULL, -661 },	// 1e-180
+	{ 0xc5dd44271ad3cdbaULL, -635 },	// 1e-172
+	{ 0x936b9fcebb25c996ULL, -608 },	// 1e-164
+	{ 0xdbac6c247d62a584ULL, -582 },	// 1e-156
+	{ 0xa3ab66580d5fdaf6ULL, -555 },	// 1e-148
+	{ 0xf3e2f893dec3f126ULL, -529 },	// 1e-140
+	{ 0xb5b5ada8aaff80b8ULL, -502 },	// 1e-132
+	{ 0x87625f056c7c4a8bULL, -475 },	// 1e-124
+	{ 0xc9bcff6034c13053ULL, -449 },	// 1e-116
+	{ 0x964e858c91ba2655ULL, -422 },	// 1e-108
+	{ 0xdff9772470297ebdULL, -396 },	// 1e-100
+	{ 0xa6dfbd9fb8e5b88fULL, -369 },	// 1e-92
+	{ 0xf8a95fcf88747d94ULL, -343 },	// 1e-84
+	{ 0xb94470938fa89bcfULL, -316 },	// 1e-76
+	{ 0x8a08f0f8bf0f156bULL, -289 },	// 1e-68
+	{ 0xcdb02555653131b6ULL, -263 },	// 1e-60
+	{ 0x993fe2c6d07b7facULL, -236 },	// 1e-52
+	{ 0xe45c10c42a2b3b06ULL, -210 },	// 1e-44
+	{ 0xaa242499697392d3ULL, -183 },	// 1e-36
+	{ 0xfd87b5f28300ca0eULL, -157 },	// 1e-28
+	{ 0xbce5086492111aebULL, -130 },	// 1e-20
+	{ 0x8cbccc096f5088ccULL, -103 },	// 1e-12
+	{ 0xd1b71758e219652cULL, -77 },	// 1e-4
+	{ 0x9c40000000000000ULL, -50 },	// 1e4
+	{ 0xe8d4a51000000000ULL, -24 },	// 1e12
+	{ 0xad78ebc5ac620000ULL, 3 },	// 1e20
+	{ 0x813f3978f8940984ULL, 30 },	// 1e28
+	{ 0xc097ce7bc90715b3ULL, 56 },	// 1e36
+	{ 0x8f7e32ce7bea5c70ULL, 83 },	// 1e44
+	{ 0xd5d238a4abe98068ULL, 109 },	// 1e52
+	{ 0x9f4f2726179a2245ULL, 136 },	// 1e60
+	{ 0xed63a231d4c4fb27ULL, 162 },	// 1e68
+	{ 0xb0de65388cc8ada8ULL, 189 },	// 1e76
+	{ 0x83c7088e1aab65dbULL, 216 },	// 1e84
+	{ 0xc45d1df942711d9aULL, 242 },	// 1e92
+	{ 0x924d692ca61be758ULL, 269 },	// 1e100
+	{ 0xda01ee641a708deaULL, 295 },	// 1e108
+	{ 0xa26da3999aef774aULL, 322 },	// 1e116
+	{ 0xf209787bb47d6b85ULL, 348 },	// 1e124
+	{ 0xb454e4a179dd1877ULL, 375 },	// 1e132
+	{ 0x865b86925b9bc5c2ULL, 402 },	// 1e140
+	{ 0xc83553c5c8965d3dULL, 428 },	// 1e148
+	{ 0x952ab45cfa97a0b3ULL, 455 },	// 1e156
+	{ 0xde469fbd99a05fe3ULL, 481 },	// 1e164
+	{ 0xa59bc234db398c25ULL, 508 },	// 1e172
+	{ 0xf6c69a72a3989f5cULL, 534 },	// 1e180
+	{ 0xb7dcbf5354e9beceULL, 561 },	// 1e188
+	{ 0x88fcf317f22241e2ULL, 588 },	// 1e196
+	{ 0xcc20ce9bd35c78a5ULL, 614 },	// 1e204
+	{ 0x98165af37b2153dfULL, 641 },	// 1e212
+	{ 0xe2a0b5dc971f303aULL, 667 },	// 1e220
+	{ 0xa8d9d1535ce3b396ULL, 694 },	// 1e228
+	{ 0xfb9b7cd9a4a7443cULL, 720 },	// 1e236
+	{ 0xbb764c4ca7a44410ULL, 747 },	// 1e244
+	{ 0x8bab8eefb6409c1aULL, 774 },	// 1e252
+	{ 0xd01fef10a657842cULL, 800 },	// 1e260
+	{ 0x9b10a4e5e9913129ULL, 827 },	// 1e268
+	{ 0xe7109bfba19c0c9dULL, 853 },	// 1e276
+	{ 0xac2820d9623bf429ULL, 880 },	// 1e284
+	{ 0x80444b5e7aa7cf85ULL, 907 },	// 1e292
+	{ 0xbf21e44003acdd2dULL, 933 },	// 1e300
+	{ 0x8e679c2f5e44ff8fULL, 960 },	// 1e308
+	{ 0xd433179d9c8cb841ULL, 986 },	// 1e316
+	{ 0x9e19db92b4e31ba9ULL, 1013 },	// 1e324
+	{ 0xeb96bf6ebadf77d9ULL, 1039 },	// 1e332
+	{ 0xaf87023b9bf0ee6bULL, 1066 },	// 1e340
+};
+#define NCACHED	(sizeof(cached_pow10) / sizeof(cached_pow10[0]))
+
+static const uint64_t pow10_64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL,
+};
+#define NPOW10	(sizeof(pow10_64) / sizeof(pow10_64[0]))
+
+#define DBL_HIDDEN	(1ULL << 52)
+
+// The upper 64 bits of the 128-bit product, rounded.
+static struct diyfp
+diyfp_mul(struct diyfp x, struct diyfp y)
+{
+	uint32_t a = x.f >> 32, b = x.f, c = y.f >> 32, d = y.f;
+	uint64_t ac = (uint64_t) a * c, bc = (uint64_t) b * c;
+	uint64_t ad = (uint64_t) a * d, bd = (uint64_t) b * d;
+	uint64_t mid = (bd >> 32) + (uint32_t) ad + (uint32_t) bc + (1U << 31);
+	struct diyfp r = { ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64 };
+
+	return r;
+}
+
+static struct diyfp
+diyfp_normalize(struct diyfp x, uint64_t topbit)
+{
+	while (!(x.f & topbit)) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+// Move the last digit down while the result stays inside the rounding
+// interval and gets closer to the exact value.
+static void
+grisu_round(char *buf, int len, uint64_t delta, uint64_t rest,
+	    uint64_t ten_kappa, uint64_t wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa
+	       && (rest + ten_kappa < wp_w
+		   || wp_w - rest > rest + ten_kappa - wp_w)) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+// Generate the digits of the positive, finite double with significand f
+// and binary exponent e into buf (at least 18 bytes).  Returns the
+// number of digits; the value is digits * 10^*k.
+static int
+grisu2(uint64_t f, int e, char *buf, int *k)
+{
+	struct diyfp v = { f, e }, wp, wm, w, one, c;
+	uint64_t delta, p2, rest, wp_w;
+	uint32_t p1, d;
+	int i, kappa, len = 0;
+
+	// The boundaries halfway to the neighbouring doubles, with the
+	// same exponent as the (normalized) upper one
+	wp.f = (f << 1) + 1;
+	wp.e = e - 1;
+	wp = diyfp_normalize(wp, DBL_HIDDEN << 1);
+	wp.f <<= 10;
+	wp.e -= 10;
+	if (f == DBL_HIDDEN) {
+		wm.f = (f << 2) - 1;
+		wm.e = e - 2;
 	} else {
-		// print any needed pad characters before first digit
-		//预留好符号的位置
-		if(sign != 0) width--;
+		wm.f = (f << 1) - 1;
+		wm.e = e - 1;
+	}
+	wm.f <<= wm.e - wp.e;
+	wm.e = wp.e;
+
+	// Scale by the cached power of ten that brings the exponent into
+	// [-60, -32], so that the integer part fits in 32 bits.
+	i = ((-61 - wp.e) * 78913 >> 18) / 8 + 43;
+	if (i < 0)
+		i = 0;
+	while (i < NCACHED - 1 && wp.e + cached_pow10[i].e + 64 < -60)
+		i++;
+	while (i > 0 && wp.e + cached_pow10[i - 1].e + 64 >= -60)
+		i--;
+	c.f = cached_pow10[i].f;
+	c.e = cached_pow10[i].e;
+	*k = 348 - 8 * i;
 
-		//填充是0，符号加在0之前
-		if(padc == '0' && sign != 0) putch(sign, putdat);
+	w = diyfp_mul(diyfp_normalize(v, 1ULL << 63), c);
+	wp = diyfp_mul(wp, c);
+	wm = diyfp_mul(wm, c);
+	wm.f++;
+	wp.f--;
+	delta = wp.f - wm.f;
+	wp_w = wp.f - w.f;
 
-		while (--width > 0) putch(padc, putdat);
+	one.e = wp.e;
+	one.f = 1ULL << -one.e;
+	p1 = wp.f >> -one.e;
+	p2 = wp.f & (one.f - 1);
+	for (kappa = 1; kappa < 10 && p1 >= pow10_64[kappa]; kappa++)
+		/* do nothing */;
+
+	// Integer part
+	while (kappa > 0) {
+		d = p1 / (uint32_t) pow10_64[kappa - 1];
+		p1 %= (uint32_t) pow10_64[kappa - 1];
+		if (d || len)
+			buf[len++] = '0' + d;
+		kappa--;
+		rest = ((uint64_t) p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			grisu_round(buf, len, delta, rest,
+				    pow10_64[kappa] << -one.e, wp_w);
+			goto done;
+		}
+	}
+
+	// Fractional part
+	while (1) {
+		p2 *= 10;
+		delta *= 10;
+		d = p2 >> -one.e;
+		if (d || len)
+			buf[len++] = '0' + d;
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k += kappa;
+			wp_w *= pow10_64[-kappa];
+			grisu_round(buf, len, delta, p2, one.f, wp_w);
+			goto done;
+		}
+	}
 
-		//填充不是0，符号加在数字之前
-		if(padc != '0' && sign != 0) putch(sign, putdat);
+done:
+	while (len > 1 && buf[len - 1] == '0') {
+		len--;
+		(*k)++;
 	}
+	return len;
+}
+
+// Round the n-digit string d (value 0.d * 10^dp) to keep significant
+// digits and drop trailing zeros; n becomes 0 for zero.  When the digits
+// end in a 5 that is cut off, more says whether the value goes on past
+// them; if not, the tie rounds to even.
+static void
+round_digits(char *d, int *n, int *dp, int keep, bool more)
+{
+	int i, up;
 
-	// then print this (the least significant) digit
-	putch("0123456789abcdef"[num % base], putdat);
+	if (keep < *n) {
+		up = (keep >= 0 && d[keep] >= '5');
+		if (up && keep == *n - 1 && d[keep] == '5')
+			up = (more || (keep > 0 && (d[keep - 1] - '0') % 2));
+		if (up) {
+			for (i = keep - 1; i >= 0 && d[i] == '9'; i--)
+				/* do nothing */;
+			if (i < 0) {
+				d[0] = '1';
+				*n = 1;
+				(*dp)++;
+			} else {
+				d[i]++;
+				*n = i + 1;
+			}
+		} else
+			*n = MAX(keep, 0);
+	}
+	while (*n > 0 && d[*n - 1] == '0')
+		(*n)--;
+}
+
+// Whether rounding grisu2's n digits d of the double m * 2^e to keep
+// significant digits is sure to give the same result as rounding the
+// double.  The digits lie within half an ulp of it, which is less than
+// 10^n / 2m units in their last place, so they must be further than
+// that from the halfway point between the two candidates.  Digits
+// past n count as zeros.
+static bool
+grisu_roundable(const char *d, int n, int keep, uint64_t m)
+{
+	uint64_t cut = 0, half = 5, err;
+	int b, i;
+
+	if (keep < 0)
+		return 1;	// below half a unit in the last place kept
+	for (b = 52; !(m >> b); b--)
+		/* subnormal */;
+	if (keep < n) {
+		for (i = keep; i < n; i++)
+			cut = cut * 10 + d[i] - '0';
+		half = 5 * pow10_64[n - keep - 1];
+		err = (pow10_64[n] >> b) + 1;
+	} else if (keep + 1 < NPOW10)
+		// In units of the first digit cut off
+		err = (pow10_64[keep + 1] >> b) + 1;
+	else
+		return 0;
+	return cut > half + err || cut + err < half;
+}
+
+// A double's integer part (up to 1024 bits) or fraction (up to 1074)
+// in 32-bit limbs, least significant first.
+#define BIGLIMBS	34
+// Significant digits that can be rounded exactly; exact_digits
+// generates one more to round with.
+#define EXACTDIGITS	40
+
+// Set limbs [0, BIGLIMBS) of big to m << shift.
+static void
+big_set(uint32_t *big, uint64_t m, int shift)
+{
+	int i = shift / 32, s = shift % 32;
+
+	memset(big, 0, BIGLIMBS * sizeof(big[0]));
+	big[i] = m << s;
+	big[i + 1] = m >> (32 - s);
+	if (s)
+		big[i + 2] = m >> (64 - s);
+}
+
+// Append the k digits at p to the n digits at d, keeping the first
+// EXACTDIGITS + 1.  Sets *more if a nonzero digit does not fit.
+static int
+put_digits(char *d, int n, const char *p, int k, bool *more)
+{
+	for (; k > 0; p++, k--)
+		if (n <= EXACTDIGITS)
+			d[n++] = *p;
+		else if (*p != '0')
+			*more = 1;
+	return n;
+}
+
+// The exact decimal expansion of the positive double m * 2^e, for when
+// grisu2's digits do not settle the rounding.  Its first EXACTDIGITS + 1
+// digits go in d, with *n and *dp as for round_digits.  Returns whether
+// more nonzero digits follow them.
+static bool
+exact_digits(uint64_t m, int e, char *d, int *n, int *dp)
+{
+	uint32_t big[BIGLIMBS], chunk[BIGLIMBS + 1];
+	unsigned long long t;
+	char buf[9], *p;
+	int i, lo, nlimb, nchunk = 0, len = 0;
+	bool more = 0;
+
+	// The integer part, as base 10^9 chunks from the least significant
+	if (e >= 0) {
+		big_set(big, m, e);
+		nlimb = e / 32 + 3;
+	} else {
+		big_set(big, -e < 64 ? m >> -e : 0, 0);
+		nlimb = 2;
+	}
+	while (nlimb > 0 && big[nlimb - 1] == 0)
+		nlimb--;
+	while (nlimb > 0) {
+		chunk[nchunk] = 0;
+		for (i = nlimb - 1; i >= 0; i--) {
+			t = (unsigned long long) chunk[nchunk] << 32 | big[i];
+			chunk[nchunk] = udiv64_32(&t, 1000000000);
+			big[i] = t;
+		}
+		nchunk++;
+		while (nlimb > 0 && big[nlimb - 1] == 0)
+			nlimb--;
+	}
+	*dp = 0;
+	for (i = nchunk - 1; i >= 0; i--) {
+		p = fmtdec32(buf + 9, chunk[i]);
+		if (i < nchunk - 1)
+			while (p > buf)
+				*--p = '0';
+		*dp += buf + 9 - p;
+		len = put_digits(d, len, p, buf + 9 - p, &more);
+	}
+
+	// The fraction, scaled to fill nlimb limbs, times 10^9 at a time
+	if (e < 0) {
+		nlimb = (-e + 31) / 32;
+		big_set(big, -e < 64 ? m & ((1ULL << -e) - 1) : m,
+			32 * nlimb + e);
+		for (lo = 0; ; ) {
+			while (lo < nlimb && big[lo] == 0)
+				lo++;
+			if (lo == nlimb)
+				break;
+			if (len > EXACTDIGITS) {
+				more = 1;
+				break;
+			}
+			t = 0;
+			for (i = lo; i < nlimb; i++) {
+				t = (unsigned long long) big[i] * 1000000000
+					+ (t >> 32);
+				big[i] = t;
+			}
+			p = fmtdec32(buf + 9, t >> 32);
+			while (p > buf)
+				*--p = '0';
+			if (len == 0)
+				for (; p < buf + 9 && *p == '0'; p++)
+					(*dp)--;
+			len = put_digits(d, len, p, buf + 9 - p, &more);
+		}
+	}
+
+	while (len > 0 && d[len - 1] == '0')
+		len--;
+	*n = len;
+	return more;
+}
+
+// Set d, *n and *dp (as for round_digits) to the digits of the positive
+// double m * 2^e rounded to keep significant digits or, if fixed, to
+// keep digits after the decimal point.  d holds EXACTDIGITS + 1.
+static void
+float_digits(uint64_t m, int e, char *d, int *n, int *dp, int keep,
+	     bool fixed)
+{
+	bool more;
+	int k;
+
+	*n = grisu2(m, e, d, &k);
+	*dp = *n + k;
+	if (grisu_roundable(d, *n, keep + (fixed ? *dp : 0), m))
+		more = 0;
+	else
+		more = exact_digits(m, e, d, n, dp);
+	round_digits(d, n, dp, keep + (fixed ? *dp : 0), more);
+}
+
+// Emit positions [from, to) of the n-digit string d, where positions
+// outside the string are zeros.
+static void
+emitdigits(struct printstate *ps, const char *d, int n, int from, int to)
+{
+	if (from < 0) {
+		emitpad(ps, '0', MIN(to, 0) - from);
+		from = 0;
+	}
+	if (from < MIN(to, n)) {
+		emit(ps, d + from, MIN(to, n) - from);
+		from = MIN(to, n);
+	}
+	emitpad(ps, '0', to - from);
+}
+
+/*
+ * Print a double as %f, %E/%e (scientific) or %g/%G.  Flags, width and
+ * padding work as for integers; precision defaults to 6; '#' keeps the
+ * decimal point (and, for %g, trailing zeros).  Results are correctly
+ * rounded to as many as EXACTDIGITS significant digits.  Where more are
+ * asked for, C prints more of the double's exact binary value (say for
+ * %.50f of 0.1, or %f of 1e300); here the digits run out and the rest
+ * are zeros.
+ */
+static void
+printfloat(struct printstate *ps, double x, int conv, int width,
+	   int precision, int padc, int sign, int altflag)
+{
+	union {
+		double d;
+		uint64_t u;
+	} bits = { x };
+	char d[EXACTDIGITS + 1], ebuf[8], *ep;
+	int n, dp, e, len, pad, exp, style;
+	uint64_t f;
+
+	if (bits.u >> 63)
+		sign = '-';
+	e = (bits.u >> 52) & 0x7FF;
+	f = bits.u & (DBL_HIDDEN - 1);
+
+	if (e == 0x7FF) {
+		// inf and nan have no digits to pad with zeros.  As in C,
+		// both take the sign, and %E and %G print them in capitals.
+		len = 3 + (sign != 0);
+		pad = width - len;
+		if (padc != '-')
+			emitpad(ps, ' ', pad);
+		if (sign)
+			emitc(ps, sign);
+		if (conv == 'E' || conv == 'G')
+			emit(ps, f ? "NAN" : "INF", 3);
+		else
+			emit(ps, f ? "nan" : "inf", 3);
+		if (padc == '-')
+			emitpad(ps, ' ', pad);
+		return;
+	}
+
+	// Zero has no digits; otherwise f * 2^e
+	n = 0;
+	dp = 1;
+	if (e != 0)
+		f |= DBL_HIDDEN;
+	e = (e ? e : 1) - 1075;
+
+	if (precision < 0)
+		precision = 6;
+	style = conv;
+	if (conv == 'g' || conv == 'G') {
+		// Choose %f or %E from the exponent after rounding to
+		// precision significant digits
+		if (precision == 0)
+			precision = 1;
+		if (f)
+			float_digits(f, e, d, &n, &dp, precision, 0);
+		exp = (n ? dp - 1 : 0);
+		if (exp < -4 || exp >= precision) {
+			style = conv - 2;
+			precision--;
+			if (!altflag)
+				precision = MIN(precision, MAX(n - 1, 0));
+		} else {
+			style = 'f';
+			precision -= 1 + exp;
+			if (!altflag)
+				precision = MIN(precision, MAX(n - dp, 0));
+		}
+	} else if (f)
+		float_digits(f, e, d, &n, &dp,
+			     conv == 'f' ? precision : precision + 1, conv == 'f');
+
+	if (style == 'f')
+		len = MAX(dp, 1);
+	else {
+		exp = (n ? dp - 1 : 0);
+		ep = ebuf + sizeof(ebuf);
+		ep = fmtdec32(ep, exp < 0 ? -exp : exp);
+		if (ebuf + sizeof(ebuf) - ep < 2)
+			*--ep = '0';
+		*--ep = (exp < 0 ? '-' : '+');
+		*--ep = style;
+		len = 1 + (ebuf + sizeof(ebuf) - ep);
+	}
+	len += (sign != 0) + (precision || altflag ? 1 + precision : 0);
+	pad = width - len;
+
+	if (padc == ' ')
+		emitpad(ps, ' ', pad);
+	if (sign)
+		emitc(ps, sign);
+	if (padc == '0')
+		emitpad(ps, '0', pad);
+	if (style == 'f') {
+		if (dp > 0)
+			emitdigits(ps, d, n, 0, dp);
+		else
+			emitc(ps, '0');
+		if (precision || altflag) {
+			emitc(ps, '.');
+			emitdigits(ps, d, n, dp, dp + precision);
+		}
+	} else {
+		emitdigits(ps, d, n, 0, 1);
+		if (precision || altflag) {
+			emitc(ps, '.');
+			emitdigits(ps, d, n, 1, 1 + precision);
+		}
+		emit(ps, ep, ebuf + sizeof(ebuf) - ep);
+	}
+	if (padc == '-')
+		emitpad(ps, ' ', pad);
+}
+
+// Emit at most len bytes of string p, replacing unprintable characters
+// with '?' when altflag is set.
+static void
+printstr(struct printstate *ps, const char *p, size_t len, int altflag)
+{
+	const char *q;
+
+	if (!altflag) {
+		emit(ps, p, len);
+		return;
+	}
+	while (len > 0) {
+		for (q = p; q < p + len && *q >= ' ' && *q <= '~'; q++)
+			/* do nothing */;
+		emit(ps, p, q - p);
+		len -= q - p;
+		p = q;
+		if (len > 0) {
+			emitc(ps, '?');
+			p++, len--;
+		}
+	}
 }
 
 // Get an unsigned int of various possible sizes from a varargs list,
@@ -106,132 +848,52 @@ getint(va_list *ap, int lflag)
 }
 
 
-// Main function to format and print a string.
-void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
-
-void
-vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+// Format one conversion, whose flags, width and precision have already
+// been parsed into *sp.  Returns -1 if sp->conv is not a conversion.
+static int
+printconv(struct printstate *ps, const struct fmtop *sp, va_list *ap)
 {
 	register const char *p;
 	register int ch, err;
+	size_t len;
 	unsigned long long num;
-	int base, lflag, width, precision, altflag;
-	char padc, sign;
+	int base;
+	char sign = sp->sign;
+	const char *prefix = "";
 	signed char *cntptr;
 
-	while (1) {
-		while ((ch = *(unsigned char *) fmt++) != '%') {
-			if (ch == '\0')
-				return;
-			putch(ch, putdat);
-		}
-
-		// Process a %-escape sequence
-		padc = ' ';
-		width = -1;
-		precision = -1;
-		lflag = 0;
-		altflag = 0;
-		//sign用于记录+号标志，0表示不需要添加符号
-		sign = 0;
-		cntptr = NULL;
-	reswitch:
-		switch (ch = *(unsigned char *) fmt++) {
-		case '+':
-			//暂时用'+'来记录要对有符号类型d强制加符号
-			sign = '+';
-			goto reswitch;
-		// flag to pad on the right
-		case '-':
-			padc = '-';
-			goto reswitch;
-
-		// flag to pad with 0's instead of spaces
-		case '0':
-			//左对齐符号出现时，会忽视掉0符号
-			if(padc != '-') padc = '0';
-			goto reswitch;
-
-		case ' ':
-			if(sign != '+') sign = ' ';
-			goto reswitch;
-
-		// width field
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			for (precision = 0; ; ++fmt) {
-				precision = precision * 10 + ch - '0';
-				ch = *fmt;
-				if (ch < '0' || ch > '9')
-					break;
-			}
-			goto process_precision;
-
-		case '*':
-			precision = va_arg(ap, int);
-			goto process_precision;
-
-		case '.':
-			if (width < 0)
-				width = 0;
-			goto reswitch;
-
-		case '#':
-			altflag = 1;
-			goto reswitch;
-
-		process_precision:
-			if (width < 0)
-				width = precision, precision = -1;
-			goto reswitch;
-
-		// long flag (doubled for long long)
-		case 'l':
-			lflag++;
-			goto reswitch;
-
+	switch (ch = sp->conv) {
 		// character
 		case 'c':
-			putch(va_arg(ap, int), putdat);
+			emitc(ps, va_arg(*ap, int));
 			break;
 
 		// error message
 		case 'e':
-			err = va_arg(ap, int);
+			err = va_arg(*ap, int);
 			if (err < 0)
 				err = -err;
 			if (err >= MAXERROR || (p = error_string[err]) == NULL)
-				printfmt(putch, putdat, "error %d", err);
+				psprintf(ps, "error %d", err);
 			else
-				printfmt(putch, putdat, "%s", p);
+				psprintf(ps, "%s", p);
 			break;
 
 		// string
 		case 's':
-			if ((p = va_arg(ap, char *)) == NULL)
+			if ((p = va_arg(*ap, char *)) == NULL)
 				p = "(null)";
-			if (width > 0 && padc != '-')
-				for (width -= strnlen(p, precision); width > 0; width--)
-					putch(padc, putdat);
-			for (; (ch = *p++) != '\0' && (precision < 0 || --precision >= 0); width--)
-				if (altflag && (ch < ' ' || ch > '~'))
-					putch('?', putdat);
-				else
-					putch(ch, putdat);
-			for (; width > 0; width--)
-				putch(' ', putdat);
+			len = strnlen(p, sp->precision);
+			if (sp->padc != '-')
+				emitpad(ps, sp->padc, sp->width - (int) len);
+			printstr(ps, p, len, sp->altflag);
+			if (sp->padc == '-')
+				emitpad(ps, ' ', sp->width - (int) len);
 			break;
 
 		// (signed) decimal
 		case 'd':
-			num = getint(&ap, lflag);
+			num = getint(ap, sp->lflag);
 			if ((long long) num < 0) {
 				sign = '-';
 				num = -(long long) num;
@@ -243,7 +905,7 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 		// unsigned decimal
 		case 'u':
 			sign = 0;
-			num = getuint(&ap, lflag);
+			num = getuint(ap, sp->lflag);
 			base = 10;
 			goto number;
 
@@ -252,27 +914,36 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			// Replace this with your code.
 			// display a number in octal form and the form should begin with '0'
 			sign = 0;
-			putch('0', putdat);
-			num = getuint(&ap, lflag);
+			prefix = "0";
+			num = getuint(ap, sp->lflag);
 			base = 8;
 			goto number;
 
 		// pointer
 		case 'p':
-			putch('0', putdat);
-			putch('x', putdat);
+			prefix = "0x";
 			num = (unsigned long long)
-				(uintptr_t) va_arg(ap, void *);
+				(uintptr_t) va_arg(*ap, void *);
 			base = 16;
 			goto number;
 
+		// floating point; %e is taken by error codes, so
+		// scientific notation is %E only
+		case 'f':
+		case 'E':
+		case 'g':
+		case 'G':
+			printfloat(ps, va_arg(*ap, double), ch, sp->width,
+				   sp->precision, sp->padc, sign, sp->altflag);
+			break;
+
 		// (unsigned) hexadecimal
 		case 'x':
 		    sign = 0;
-			num = getuint(&ap, lflag);
+			num = getuint(ap, sp->lflag);
 			base = 16;
 		number:
-			printnum(putch, putdat, num, base, width, padc, sign);
+			printnum(ps, num, base, sp->width, sp->padc, sign, prefix);
 			break;
 
         case 'n': {
@@ -296,25 +967,130 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
             const char *overflow_error = "\nwarning! The value %n argument pointed to has been overflowed!\n";
 
             // Your code here
-			cntptr = va_arg(ap, signed char *);
-			if(cntptr == NULL) printfmt(putch, putdat, "%s", null_error);
-			else if(*((int *)putdat) > 127) {
-				printfmt(putch, putdat, "%s", overflow_error);
+			cntptr = va_arg(*ap, signed char *);
+			if(cntptr == NULL) psprintf(ps, "%s", null_error);
+			else if(ps->cnt > 127) {
+				psprintf(ps, "%s", overflow_error);
 				*cntptr = -1;
 			}
-			else *cntptr = *((int *)putdat);
+			else *cntptr = ps->cnt;
 
             break;
         }
 
 		// escaped '%' character
 		case '%':
-			putch(ch, putdat);
+			emitc(ps, ch);
 			break;
 
-		// unrecognized escape sequence - just print it literally
 		default:
-			putch('%', putdat);
+			return -1;
+	}
+	return 0;
+}
+
+// Main function to format and print a string.
+static void
+vprintfmt_ps(struct printstate *ps, const char *fmt, va_list ap)
+{
+	register const char *p;
+	register int ch;
+	int width, precision;
+	struct fmtop spec;
+
+	while (1) {
+		// Emit the literal run up to the next '%' in one go
+		for (p = fmt; *p != '\0' && *p != '%'; p++)
+			/* do nothing */;
+		emit(ps, fmt, p - fmt);
+		if (*p == '\0')
+			return;
+		fmt = p + 1;
+
+		// Process a %-escape sequence
+		memset(&spec, 0, sizeof(spec));
+		spec.padc = ' ';
+		width = -1;
+		precision = -1;
+	reswitch:
+		switch (ch = *(unsigned char *) fmt++) {
+		case '+':
+			//暂时用'+'来记录要对有符号类型d强制加符号
+			spec.sign = '+';
+			goto reswitch;
+		// flag to pad on the right
+		case '-':
+			spec.padc = '-';
+			goto reswitch;
+
+		// flag to pad with 0's instead of spaces
+		case '0':
+			//左对齐符号出现时，会忽视掉0符号
+			if(spec.padc != '-') spec.padc = '0';
+			goto reswitch;
+
+		case ' ':
+			if(spec.sign != '+') spec.sign = ' ';
+			goto reswitch;
+
+		// width field
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			for (precision = 0; ; ++fmt) {
+				precision = precision * 10 + ch - '0';
+				ch = *fmt;
+				if (ch < '0' || ch > '9')
+					break;
+			}
+			goto process_precision;
+
+		case '*':
+			precision = va_arg(ap, int);
+			goto process_precision;
+
+		case '.':
+			if (width < 0)
+				width = 0;
+			// Digits after '.' are the precision, even a leading
+			// zero, which would otherwise read as the '0' flag
+			if (*fmt == '*') {
+				precision = va_arg(ap, int);
+				fmt++;
+			} else
+				for (precision = 0; *fmt >= '0' && *fmt <= '9'; fmt++)
+					precision = precision * 10 + *fmt - '0';
+			goto reswitch;
+
+		case '#':
+			spec.altflag = 1;
+			goto reswitch;
+
+		process_precision:
+			if (width < 0)
+				width = precision, precision = -1;
+			goto reswitch;
+
+		// long flag (doubled for long long)
+		case 'l':
+			spec.lflag++;
+			goto reswitch;
+
+		default:
+			spec.conv = ch;
+			spec.width = width;
+			spec.precision = precision;
+			if (printconv(ps, &spec, &ap) == 0)
+				break;
+
+			// unrecognized escape sequence - just print it literally
+			emitc(ps, '%');
 			for (fmt--; fmt[-1] != '%'; fmt--)
 				/* do nothing */;
 			break;
@@ -322,6 +1098,74 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 	}
 }
 
+static void
+psprintf(struct printstate *ps, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintfmt_ps(ps, fmt, ap);
+	va_end(ap);
+}
+
+// Format into a sink that takes whole spans of output at a time.
+void
+vprintfmt_span(void (*putspan)(const char *, size_t, void *), void *putdat,
+	       const char *fmt, va_list ap)
+{
+	struct printstate ps = {putspan, putdat, 0};
+
+	vprintfmt_ps(&ps, fmt, ap);
+}
+
+// Format from a precompiled op list for fmt, or by parsing fmt if there
+// is none.
+void
+vprintfmt_ops(void (*putspan)(const char *, size_t, void *), void *putdat,
+	      const char *fmt, const struct fmtop *op, va_list ap)
+{
+	struct printstate ps = {putspan, putdat, 0};
+	struct fmtop spec;
+
+	if (op == NULL) {
+		vprintfmt_ps(&ps, fmt, ap);
+		return;
+	}
+	for (; op->conv != 0 || op->len != 0; op++) {
+		if (op->conv == 0) {
+			emit(&ps, fmt + op->off, op->len);
+			continue;
+		}
+		spec = *op;
+		if (spec.width == FMTOP_STAR)
+			spec.width = va_arg(ap, int);
+		if (spec.precision == FMTOP_STAR)
+			spec.precision = va_arg(ap, int);
+		printconv(&ps, &spec, &ap);
+	}
+}
+
+// Adapter for the original one-character-at-a-time interface.
+struct putchspan {
+	void (*putch)(int, void*);
+	void *putdat;
+};
+
+static void
+putchspan(const char *buf, size_t len, struct putchspan *pc)
+{
+	while (len-- > 0)
+		pc->putch(*buf++, pc->putdat);
+}
+
+void
+vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+{
+	struct putchspan pc = {putch, putdat};
+
+	vprintfmt_span((void*)putchspan, &pc, fmt, ap);
+}
+
 void
 printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...)
 {
@@ -339,11 +1183,13 @@ struct sprintbuf {
 };
 
 static void
-sprintputch(int ch, struct sprintbuf *b)
+sprintputspan(const char *s, size_t len, struct sprintbuf *b)
 {
-	b->cnt++;
-	if (b->buf < b->ebuf)
-		*b->buf++ = ch;
+	size_t n = MIN(len, (size_t) (b->ebuf - b->buf));
+
+	memmove(b->buf, s, n);
+	b->buf += n;
+	b->cnt += len;
 }
 
 int
@@ -355,7 +1201,7 @@ vsnprintf(char *buf, int n, const char *fmt, va_list ap)
 		return -E_INVAL;
 
 	// print the string to the buffer
-	vprintfmt((void*)sprintputch, &b, fmt, ap);
+	vprintfmt_span((void*)sprintputspan, &b, fmt, ap);
 
 	// null terminate the buffer
 	*b.buf = '\0';
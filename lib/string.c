@@ -1,6 +1,8 @@
-// Basic string routines.  Not hardware optimized, but not shabby.
+// Basic string routines, tuned to the CPU through cpu_has().
 
 #include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/cpufeature.h>
 
 // Using assembly for memset/memmove
 // makes some difference on real hardware,
@@ -8,24 +10,129 @@
 // Primespipe runs 3x faster this way.
 #define ASM 1
 
+// The SSE2 and ERMSB code paths are taken only once cpu_features
+// (inc/cpufeature.h) says they may be: until then, and in programs
+// that never set it, only general registers and dword string
+// instructions are used.
+
+// Sizes, in bytes, from which each method pays for its setup
+#define ERMS_MIN	128		// rep movsb/stosb start-up
+#define SSE2_MIN	64
+#define NT_MIN		(4 * 1024 * 1024)	// beyond the last-level cache
+
+// Word-at-a-time scanning.  Reads are aligned, so they never cross
+// into a page that the bytes asked about do not touch.
+
+// An aligned, aliasing 32-bit word
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+// An unaligned one, for the edges of a buffer
+typedef uint32_t __attribute__((__may_alias__, __aligned__(1))) uword_t;
+
+#define ONES	0x01010101
+#define HIGHS	0x80808080
+
+// Nonzero if a byte of w is zero.  Borrows can set the high bit of
+// bytes above the first zero, but the lowest bit set is exact.
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+
+// Bit mask of the bytes of the aligned word at p that equal either
+// c1 or c2 (both repeated in every byte).  The low 'skip' bytes come
+// before the range asked about and must not match: ORing in 0xFF
+// rather than masking afterwards keeps them from borrowing.
+static __inline uint32_t
+match4(const char *p, size_t skip, uint32_t c1, uint32_t c2)
+{
+	uint32_t w = *(const word_t *) p, pre = (1 << (8 * skip)) - 1;
+
+	return HASZERO((w ^ c1) | pre) | HASZERO((w ^ c2) | pre);
+}
+
+// The SSE2 scan: find the first aligned 16-byte block from p on,
+// stopping at end, that has a byte equal to c1 or c2, and return it
+// with *mp set to the matching bytes, one bit each.  Returns a block
+// at or beyond end with *mp zero if there is none.  'skip' bytes at
+// the start of the first block do not count.
+static const char * __attribute__((target("sse2")))
+scan16(const char *p, size_t skip, const char *end, uint32_t c1, uint32_t c2,
+       uint32_t *mp)
+{
+	uint32_t m;
+
+	asm("movd %3, %%xmm1\n\t"
+	    "pshufd $0, %%xmm1, %%xmm1\n\t"
+	    "movd %4, %%xmm2\n\t"
+	    "pshufd $0, %%xmm2, %%xmm2\n\t"
+	    "movdqa (%0), %%xmm0\n\t"
+	    "movdqa %%xmm0, %%xmm3\n\t"
+	    "pcmpeqb %%xmm1, %%xmm0\n\t"
+	    "pcmpeqb %%xmm2, %%xmm3\n\t"
+	    "por %%xmm3, %%xmm0\n\t"
+	    "pmovmskb %%xmm0, %1\n\t"
+	    "andl %2, %1\n\t"
+	    "jnz 2f\n"
+	    "1:\taddl $16, %0\n\t"
+	    "cmpl %5, %0\n\t"
+	    "jae 2f\n\t"
+	    "movdqa (%0), %%xmm0\n\t"
+	    "movdqa %%xmm0, %%xmm3\n\t"
+	    "pcmpeqb %%xmm1, %%xmm0\n\t"
+	    "pcmpeqb %%xmm2, %%xmm3\n\t"
+	    "por %%xmm3, %%xmm0\n\t"
+	    "pmovmskb %%xmm0, %1\n\t"
+	    "testl %1, %1\n\t"
+	    "jz 1b\n"
+	    "2:"
+	    : "+r" (p), "=&r" (m)
+	    : "rm" (~0U << skip), "rm" (c1), "rm" (c2), "rm" (end)
+	    : "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+	*mp = m;
+	return p;
+}
+
+// Return a pointer to the first byte in the n bytes at s that is c1 or
+// c2, or to the end if there is none.  The scan stops at a match, so n
+// may run past the end of a string being searched for its '\0'.
+// Inlined, so that each caller's constant characters fold away.
+static __inline const char * __attribute__((always_inline))
+scan(const char *s, size_t n, int c1, int c2)
+{
+	const char *p, *end;
+	uint32_t m;
+
+	// Stop at the top of the address space if s + n would wrap
+	end = (n < -(uintptr_t) s ? s + n : (const char *) ~0);
+	if (s >= end)
+		return end;
+
+	c1 = (c1 & 0xFF) * ONES;
+	c2 = (c2 & 0xFF) * ONES;
+	if (cpu_has(CPU_SSE2)) {
+		p = ROUNDDOWN(s, 16);
+		p = scan16(p, s - p, end, c1, c2, &m);
+		if (m == 0)
+			return end;
+		p += __builtin_ctz(m);
+	} else {
+		p = ROUNDDOWN(s, 4);
+		for (m = match4(p, s - p, c1, c2); m == 0;
+		     m = match4(p, 0, c1, c2))
+			if ((p += 4) >= end)
+				return end;
+		p += __builtin_ctz(m) / 8;
+	}
+	return p < end ? p : end;
+}
+
 int
 strlen(const char *s)
 {
-	int n;
-
-	for (n = 0; *s != '\0'; s++)
-		n++;
-	return n;
+	return scan(s, ~0, '\0', '\0') - s;
 }
 
 int
 strnlen(const char *s, size_t size)
 {
-	int n;
-
-	for (n = 0; size > 0 && *s != '\0'; s++, size--)
-		n++;
-	return n;
+	return scan(s, size, '\0', '\0') - s;
 }
 
 char *
@@ -92,10 +199,8 @@ strncmp(const char *p, const char *q, size_t n)
 char *
 strchr(const char *s, char c)
 {
-	for (; *s; s++)
-		if (*s == c)
-			return (char *) s;
-	return 0;
+	s = scan(s, ~0, c, '\0');
+	return *s ? (char *) s : 0;
 }
 
 // Return a pointer to the first occurrence of 'c' in 's',
@@ -103,60 +208,270 @@ strchr(const char *s, char c)
 char *
 strfind(const char *s, char c)
 {
-	for (; *s; s++)
-		if (*s == c)
-			break;
-	return (char *) s;
+	return (char *) scan(s, ~0, c, '\0');
 }
 
 #if ASM
+// The rep string instructions, advancing the pointers past what they did.
+static __inline void
+rep_stosb(char **d, int c, size_t n)
+{
+	asm volatile("cld; rep stosb"
+		: "+D" (*d), "+c" (n) : "a" (c) : "cc", "memory");
+}
+
+static __inline void
+rep_stosl(char **d, uint32_t c, size_t n)
+{
+	asm volatile("cld; rep stosl"
+		: "+D" (*d), "+c" (n) : "a" (c) : "cc", "memory");
+}
+
+static __inline void
+rep_movsb(char **d, const char **s, size_t n)
+{
+	asm volatile("cld; rep movsb"
+		: "+D" (*d), "+S" (*s), "+c" (n) : : "cc", "memory");
+}
+
+static __inline void
+rep_movsl(char **d, const char **s, size_t n)
+{
+	asm volatile("cld; rep movsl"
+		: "+D" (*d), "+S" (*s), "+c" (n) : : "cc", "memory");
+}
+
+// Downward copy of n words ending just below d and s.
+// Some versions of GCC rely on DF being clear, so clear it again.
+static __inline void
+rep_movsl_back(char *d, const char *s, size_t n)
+{
+	d -= 4;
+	s -= 4;
+	asm volatile("std; rep movsl; cld"
+		: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+}
+
+// Dword stores.  The first and last four bytes are written unaligned,
+// so one rep stosl over the aligned words in between covers the rest.
+static void
+memset_dword(char *p, int c, size_t n)
+{
+	uint32_t w = c * 0x01010101;
+	char *a;
+
+	if (n < 4) {
+		while (n-- > 0)
+			*p++ = c;
+		return;
+	}
+	*(uword_t *) p = w;
+	*(uword_t *) (p + n - 4) = w;
+	if (n > 8) {
+		a = ROUNDDOWN(p + 4, 4);
+		rep_stosl(&a, w, (p + n - a) / 4);
+	}
+}
+
+// 64 bytes per iteration of aligned 16-byte stores from %xmm0, to
+// (%0) for %1 iterations.  Non-temporal stores go around the cache
+// and need an sfence to be ordered with what follows.
+#define SSE2_STORE64(st)			\
+	"1:\t" st " %%xmm0, (%0)\n\t"		\
+	st " %%xmm0, 16(%0)\n\t"		\
+	st " %%xmm0, 32(%0)\n\t"		\
+	st " %%xmm0, 48(%0)\n\t"		\
+	"addl $64, %0\n\t"			\
+	"decl %1\n\t"				\
+	"jnz 1b\n"
+
+// The same for n >= 16 bytes: unaligned stores to the first and last
+// 16 bytes, aligned ones in between, the bulk of them 64 at a time.
+#define SSE2_MEMSET(st, fence)					\
+	asm volatile("movd %4, %%xmm0\n\t"			\
+		"pshufd $0, %%xmm0, %%xmm0\n\t"			\
+		"movdqu %%xmm0, (%2)\n\t"			\
+		"movdqu %%xmm0, (%3)\n\t"			\
+		"testl %1, %1\n\t"				\
+		"jz 2f\n"					\
+		SSE2_STORE64(st)				\
+		"2:\tcmpl %3, %0\n\t"				\
+		"jae 3f\n\t"					\
+		"movdqa %%xmm0, (%0)\n\t"			\
+		"addl $16, %0\n\t"				\
+		"jmp 2b\n"					\
+		"3:\t" fence					\
+		: "+r" (a), "+r" (nblk)				\
+		: "r" (p), "r" (p + n - 16), "r" (c * 0x01010101) \
+		: "cc", "memory", "xmm0")
+
+// Compiled for SSE2 so that the asm may clobber XMM registers; only
+// called when cpu_has(CPU_SSE2).
+static void __attribute__((target("sse2")))
+memset_sse2(char *p, int c, size_t n, bool nt)
+{
+	char *a = ROUNDDOWN(p + 16, 16);
+	size_t nblk = (p + n - a) / 64;
+
+	if (nt)
+		SSE2_MEMSET("movntdq", "sfence");
+	else
+		SSE2_MEMSET("movdqa", "");
+}
+
 void *
 memset(void *v, int c, size_t n)
 {
-	char *p;
-
-	if (n == 0)
-		return v;
-	if ((int)v%4 == 0 && n%4 == 0) {
-		c &= 0xFF;
-		c = (c<<24)|(c<<16)|(c<<8)|c;
-		asm volatile("cld; rep stosl\n"
-			:: "D" (v), "a" (c), "c" (n/4)
-			: "cc", "memory");
-	} else
-		asm volatile("cld; rep stosb\n"
-			:: "D" (v), "a" (c), "c" (n)
-			: "cc", "memory");
+	char *p = v;
+
+	c &= 0xFF;
+	if (cpu_has(CPU_SSE2) && n >= NT_MIN)
+		memset_sse2(p, c, n, 1);
+	else if (cpu_has(CPU_ERMS) && n >= ERMS_MIN)
+		rep_stosb(&p, c, n);
+	else if (cpu_has(CPU_SSE2) && n >= SSE2_MIN)
+		memset_sse2(p, c, n, 0);
+	else
+		memset_dword(p, c, n);
 	return v;
 }
 
-void *
-memmove(void *dst, const void *src, size_t n)
+// Upward dword copy, like memset_dword.  The edge words are loaded
+// before anything is stored, and each middle word is read before the
+// stores reach it, so this is also right for overlapping buffers with
+// d below s.
+static void
+memmove_dword(char *d, const char *s, size_t n)
 {
-	const char *s;
-	char *d;
-	
-	s = src;
-	d = dst;
-	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("std; rep movsl\n"
-				:: "D" (d-4), "S" (s-4), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("std; rep movsb\n"
-				:: "D" (d-1), "S" (s-1), "c" (n) : "cc", "memory");
-		// Some versions of GCC rely on DF being clear
-		asm volatile("cld" ::: "cc");
-	} else {
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("cld; rep movsl\n"
-				:: "D" (d), "S" (s), "c" (n/4) : "cc", "memory");
+	uint32_t head, tail;
+	size_t k;
+
+	if (n < 4) {
+		while (n-- > 0)
+			*d++ = *s++;
+		return;
+	}
+	head = *(const uword_t *) s;
+	tail = *(const uword_t *) (s + n - 4);
+	if (n > 8) {
+		char *a = d + (k = 4 - ((uintptr_t) d & 3));
+		const char *as = s + k;
+		rep_movsl(&a, &as, (n - k) / 4);
+	}
+	*(uword_t *) d = head;
+	*(uword_t *) (d + n - 4) = tail;
+}
+
+// Downward dword copy for overlapping buffers with d above s: the
+// mirror image of memmove_dword, aligning the end of the destination.
+static void
+memmove_back(char *d, const char *s, size_t n)
+{
+	uint32_t head, tail;
+	size_t k;
+
+	if (n < 4) {
+		while (n-- > 0)
+			d[n] = s[n];
+		return;
+	}
+	head = *(const uword_t *) s;
+	tail = *(const uword_t *) (s + n - 4);
+	if (n > 8) {
+		k = n - ((uintptr_t) (d + n) & 3);
+		rep_movsl_back(d + k, s + k, k / 4);
+	}
+	*(uword_t *) d = head;
+	*(uword_t *) (d + n - 4) = tail;
+}
+
+static __inline void __attribute__((target("sse2")))
+copy16(char *d, const char *s)
+{
+	asm volatile("movdqu (%1), %%xmm0\n\t"
+		"movdqu %%xmm0, (%0)"
+		: : "r" (d), "r" (s) : "memory", "xmm0");
+}
+
+// Upward copy through %xmm0-3, 64 bytes at a time: unaligned loads,
+// aligned stores.
+#define SSE2_COPY64(st)				\
+	"1:\tmovdqu (%1), %%xmm0\n\t"		\
+	"movdqu 16(%1), %%xmm1\n\t"		\
+	"movdqu 32(%1), %%xmm2\n\t"		\
+	"movdqu 48(%1), %%xmm3\n\t"		\
+	st " %%xmm0, (%0)\n\t"			\
+	st " %%xmm1, 16(%0)\n\t"		\
+	st " %%xmm2, 32(%0)\n\t"		\
+	st " %%xmm3, 48(%0)\n\t"		\
+	"addl $64, %1\n\t"			\
+	"addl $64, %0\n\t"			\
+	"decl %2\n\t"				\
+	"jnz 1b\n"
+
+// For n >= 16, with s not within 64 bytes above d: an unaligned
+// 16-byte copy up to the destination's alignment, the aligned loop,
+// then 16-byte copies of what is left, the last one ending exactly at
+// the end and perhaps overlapping what was already copied.
+static void __attribute__((target("sse2")))
+memmove_sse2(char *d, const char *s, size_t n, bool nt)
+{
+	size_t k = 16 - ((uintptr_t) d & 15), nblk;
+
+	copy16(d, s);
+	d += k;
+	s += k;
+	n -= k;
+	if ((nblk = n / 64) > 0) {
+		if (nt)
+			asm volatile(SSE2_COPY64("movntdq")
+				"sfence"
+				: "+r" (d), "+r" (s), "+r" (nblk) :
+				: "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3");
 		else
-			asm volatile("cld; rep movsb\n"
-				:: "D" (d), "S" (s), "c" (n) : "cc", "memory");
+			asm volatile(SSE2_COPY64("movdqa")
+				: "+r" (d), "+r" (s), "+r" (nblk) :
+				: "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3");
 	}
+	for (n &= 63; n > 16; d += 16, s += 16, n -= 16)
+		copy16(d, s);
+	copy16(d + n - 16, s + n - 16);
+}
+
+void *
+memmove(void *dst, const void *src, size_t n)
+{
+	const char *s = src;
+	char *d = dst;
+
+	// Downward copies, and upward ones whose source is close enough
+	// to be overwritten by the wide stores (and that defeat fast
+	// rep movsb), use dwords.
+	if (s < d && s + n > d)
+		memmove_back(d, s, n);
+	else if (d < s && s - d < 64)
+		memmove_dword(d, s, n);
+	else
+		memcpy(d, s, n);
+	return dst;
+}
+
+// Copy between buffers that do not overlap, always upward.  GCC also
+// calls this for structure assignments.
+void *
+memcpy(void *dst, const void *src, size_t n)
+{
+	const char *s = src;
+	char *d = dst;
+
+	if (cpu_has(CPU_SSE2) && n >= NT_MIN)
+		memmove_sse2(d, s, n, 1);
+	else if (cpu_has(CPU_ERMS) && n >= ERMS_MIN)
+		rep_movsb(&d, &s, n);
+	else if (cpu_has(CPU_SSE2) && n >= SSE2_MIN)
+		memmove_sse2(d, s, n, 0);
+	else
+		memmove_dword(d, s, n);
 	return dst;
 }
 
@@ -176,7 +491,16 @@ memset(void *v, int c, size_t n)
 	return v;
 }
 
-/* no memcpy - use memmove instead */
+void *
+memcpy(void *dst, const void *src, size_t n)
+{
+	const char *s = src;
+	char *d = dst;
+
+	while (n-- > 0)
+		*d++ = *s++;
+	return dst;
+}
 
 void *
 memmove(void *dst, const void *src, size_t n)
@@ -199,37 +523,73 @@ memmove(void *dst, const void *src, size_t n)
 }
 #endif
 
-/* sigh - gcc emits references to this for structure assignments! */
-/* it is *not* prototyped in inc/string.h - do not use directly. */
-void *
-memcpy(void *dst, void *src, size_t n)
+// Compare a word at a time, unaligned.  A last partial word is
+// compared as the word ending the buffers, overlapping bytes already
+// found equal.
+int
+memcmp(const void *v1, const void *v2, size_t n)
 {
-	return memmove(dst, src, n);
+	const uint8_t *s1 = (const uint8_t *) v1;
+	const uint8_t *s2 = (const uint8_t *) v2;
+	uint32_t a, b;
+	int k;
+
+	if (n < 4) {
+		for (; n > 0; n--, s1++, s2++)
+			if (*s1 != *s2)
+				return (int) *s1 - (int) *s2;
+		return 0;
+	}
+	for (;;) {
+		a = *(const uword_t *) s1;
+		b = *(const uword_t *) s2;
+		if (a != b)
+			break;
+		if (n == 4)
+			return 0;
+		k = (n < 8 ? n - 4 : 4);
+		s1 += k, s2 += k, n -= k;
+	}
+	// Little-endian: the first differing byte is the lowest one
+	k = __builtin_ctz(a ^ b) & ~7;
+	return (int) ((a >> k) & 0xFF) - (int) ((b >> k) & 0xFF);
 }
 
+// Like memcmp, but only says whether the buffers differ (nonzero)
+// or not, so it can look at whole words without finding where.
 int
-memcmp(const void *v1, const void *v2, size_t n)
+bcmp(const void *v1, const void *v2, size_t n)
 {
 	const uint8_t *s1 = (const uint8_t *) v1;
 	const uint8_t *s2 = (const uint8_t *) v2;
 
-	while (n-- > 0) {
-		if (*s1 != *s2)
-			return (int) *s1 - (int) *s2;
-		s1++, s2++;
+	if (n < 4) {
+		for (; n > 0; n--)
+			if (*s1++ != *s2++)
+				return 1;
+		return 0;
 	}
-
-	return 0;
+	if (n <= 8)
+		// The first and last words cover them
+		return ((*(const uword_t *) s1 ^ *(const uword_t *) s2)
+			| (*(const uword_t *) (s1 + n - 4)
+			   ^ *(const uword_t *) (s2 + n - 4))) != 0;
+	for (; n > 8; s1 += 8, s2 += 8, n -= 8)
+		if ((*(const uword_t *) s1 ^ *(const uword_t *) s2)
+		    | (*(const uword_t *) (s1 + 4) ^ *(const uword_t *) (s2 + 4)))
+			return 1;
+	// 1 to 8 bytes left, with at least 8 behind them: the last two
+	// words cover them, going back over some already compared
+	return ((*(const uword_t *) (s1 + n - 8)
+		 ^ *(const uword_t *) (s2 + n - 8))
+		| (*(const uword_t *) (s1 + n - 4)
+		   ^ *(const uword_t *) (s2 + n - 4))) != 0;
 }
 
 void *
 memfind(const void *s, int c, size_t n)
 {
-	const void *ends = (const char *) s + n;
-	for (; s < ends; s++)
-		if (*(const unsigned char *) s == (unsigned char) c)
-			break;
-	return (void *) s;
+	return (void *) scan(s, n, c, c);
 }
 
 long